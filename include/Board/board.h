@@ -2,7 +2,9 @@
 #define board_representation
 
 #include <string>
+#include <string_view>
 #include <span>
+#include <cstdint>
 #include "utils.h"
 
 using std::string;
@@ -17,10 +19,21 @@ namespace board
         bool side;
         U64 occupancies[3];
         U64 zobrist_hash;
-        // TODO: half and full move counters
+        int halfmove_clock;  // plies since the last capture or pawn move
+        int fullmove_number;
     };
     board_state make_move(board_state board, unsigned int move);
 
+    // the canonical 24 byte form of a position, for dataset files, exact keys and messages between processes.
+    // the pieces are stored in the order of the occupied squares, four bits each, and the rest of the state
+    // is folded into codes that no piece needs: 12 is a pawn that has just moved two squares, 13 a rook that
+    // can still castle and 15 the black king with black to move. the move clocks are not part of a position
+    struct packed_board {
+        U64 occupancy;
+        uint8_t pieces[16];
+        bool operator==(const packed_board &other) const = default;
+    };
+
     int find_captured_piece(board_state &board, int square);
     int find_piece(board_state &board, int square);
     bool is_promoting(board_state &board);
@@ -40,7 +53,24 @@ namespace board
 
 namespace board_utils
 {
-    board::board_state parse_fen(string fen);
+    enum class fen_error {none, placement, kings, pawns, piece_count, side, castling, enpassant, clocks, trailing_text, king_capturable};
+    const char *fen_error_text(fen_error error);
+
+    // the four fields of a fen and the two optional clocks, with nothing but white space after them. the position
+    // needs one king and at most 16 pieces per side, no pawns on the back ranks and the side not to move out of check
+    fen_error parse_fen(std::string_view fen, board::board_state &board);
+    board::board_state parse_fen(std::string_view fen);  // throws std::invalid_argument for an invalid fen
+
+    // one fen per line, empty lines skipped. fills boards and errors from the front until either is full or the
+    // text ends, and returns how many were filled. position is moved past the last line that was parsed
+    size_t parse_fen_lines(std::string_view text, size_t &position, std::span<board::board_state> boards, std::span<fen_error> errors);
+
+    const size_t max_fen_length = 105;  // the longest placement with clocks of any int value
+    size_t to_fen(const board::board_state &board, char *buffer);  // writes at most max_fen_length characters, returns how many
+    string to_fen(const board::board_state &board);
+
+    board::packed_board pack_board(const board::board_state &board);
+    board::board_state unpack_board(const board::packed_board &packed, int halfmove_clock = 0, int fullmove_number = 1);
     U64 get_zobrist_hash(board::board_state &board);
     void print_board(board::board_state &board);
     void print_move_list(std::span<unsigned int> move_list);
@@ -2,70 +2,154 @@
 #define engine_functions
 
 #include "Board/board.h"
+#include "Engine/timeManager.h"
+#include "Engine/fiber.h"
+#include "Engine/transpositionTable.h"
+#include "Engine/evaluationParameters.h"
+#include "Engine/defaultParameters.h"
+#include "MoveGenerator/MoveGenerator.h"
 #include "utils.h"
 
 #include <array>
 #include <span>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <functional>
 
 using board::board_state;
+using time_manager::search_limits;
+using move_generator::attack_info;
+using transposition_table::TranspositionTable;
 using namespace constants;
 
 using std::array;
 using std::span;
+using std::vector;
+
+
+struct principal_variation {
+    int evaluation;
+    int depth;
+    vector<unsigned int> moves;
+};
+
+
+// progress of the search, reported after every completed line of an iteration
+struct search_info {
+    int depth;
+    int selective_depth;  // deepest ply reached, including the quiescence search
+    int multi_pv;  // 1 based index of the line
+    int evaluation;
+    U64 nodes;  // searched by all threads since the start of the search
+    U64 nodes_per_second;
+    int time;  // milliseconds since the start of the search
+    int hashfull;  // permille of the transposition table in use
+    vector<unsigned int> principal_variation;
+};
+typedef std::function<void(const search_info &)> info_callback;
 
 
 class Engine {
     public:
-        int nodes_searched();
+        Engine();  // with a transposition table of its own
+        Engine(std::shared_ptr<TranspositionTable> shared_table);
+        ~Engine();  // abandons a sliced search that is still suspended
+        void set_transposition_table(std::shared_ptr<TranspositionTable> shared_table);
+        std::shared_ptr<TranspositionTable> get_transposition_table();
+
+        U64 nodes_searched();
         unsigned int best_move();
+        unsigned int ponder_move(board_state &board);
+        void set_multi_pv(int lines);
+        void set_threads(int threads);
+        const vector<principal_variation>& get_principal_variations();
         int iterative_search(board_state &board, int time_milli_seconds);
-        void print_principal_variation();
+        int iterative_search(board_state &board, search_limits limits);
+        void set_info_callback(info_callback callback);  // nothing is reported without one
+        void set_evaluation_parameters(const evaluation_parameters &new_parameters);
+        int static_evaluation(board_state &board);  // from the view of the side to move
+        void stop();
+
+        // the same search run in time slices, so that a single threaded caller can do other work in between
+        void start_search(board_state &board, search_limits limits);
+        void abandon_search();  // stops a sliced search and lets it return, so that its stack is unwound
+        bool search_step(int budget_milli_seconds);  // returns true when the search has finished
+        bool search_step_nodes(U64 node_budget);  // the same with the slice measured in nodes, for fair scheduling
+        int search_result();
+        void ponder_hit();
+        void clear_history();
+        void add_to_history(U64 zobrist_hash);
+        void clear_move_ordering();  // the killer, history and pv moves left by earlier searches
 
     private:
+        int aspiration_search(board_state &board, int depth, bool in_check, int previous_evaluation);
         int negamax(board_state &board, int alpha, int beta, int depth, int depth_from_root, int total_extension, bool in_check, bool allow_pruning);
-        int quiescence_search(board_state &board, int alpha, int beta);
-        int evaluate(board_state &board);
-        void sort_moves(span<unsigned int> moves, bool score_pv_move, int depth_from_root);
+        int quiescence_search(board_state &board, int alpha, int beta, int depth_from_root);
+        int evaluate(board_state &board, attack_info &attack_map);
+        void sort_moves(board_state &board, span<unsigned int> moves, bool score_pv_move, int depth_from_root);
         int late_move_reduction(unsigned int move, int depth, int move_priority_index, int search_extension);
         int search_extension(unsigned int move, int total_extension, bool in_check, int n_moves);
-        bool time_up();
-
-        int nodes = 0;
+        bool should_stop();
+        void check_time();
+        void count_node(int depth_from_root);
+        static void run_sliced_search(void *engine);
+        bool resume_search();
+
+        std::atomic<U64> nodes{0};  // only written by the searching thread, read by the main thread for the totals
+        int selective_depth = 0;
+        U64 node_limit = 0;  // 0 if the search is not limited by nodes
+        info_callback report_info;
         static const int max_ply = 64;
-        array<array<unsigned int, max_ply>, max_ply> pv_table;
-        array<int, max_ply> pv_length;
-
-        std::chrono::time_point<std::chrono::steady_clock> search_start_time;
-        std::chrono::milliseconds time_limit{10000};  // Time for the search
-
-        array<array<unsigned int, 2>, max_ply> killer_moves;
-        array<array<unsigned int, 12>, 64> history_moves;
-
-        const array<int, 12> material_score = {100, 300, 350, 500, 1000, check_mate_score, -100, -300, -350, -500, -1000, -check_mate_score};
-
-        // attacker, victim
-        const array<array<int, 12>, 12> mvv_lva = {{
-            {105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605},
-            {104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604},
-            {103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603},
-            {102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602},
-            {101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601},
-            {100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600},
-
-            {105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605},
-            {104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604},
-            {103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603},
-            {102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602},
-            {101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601},
-            {100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600}
-        }};
+        array<array<unsigned int, max_ply>, max_ply> pv_table{};
+        array<int, max_ply> pv_length{};
+        static constexpr int max_search_depth = max_ply - 20;  // leaves room for the search extensions
+
+        // best lines of the last iterations, sorted by evaluation
+        int multi_pv = 1;
+        vector<principal_variation> principal_variations;
+        array<unsigned int, max_moves> excluded_root_moves{};
+        int n_excluded_root_moves = 0;
+
+        std::shared_ptr<TranspositionTable> table;
+
+        // lazy smp, the helpers search the same position and only communicate through the transposition table
+        int n_threads = 1;
+        int thread_index = 0;  // 0 for the main thread, which reports and decides when to stop
+        vector<std::unique_ptr<Engine>> helpers;
+
+        fiber::Fiber search_fiber;
+        bool in_slice = false;
+        std::chrono::time_point<std::chrono::steady_clock> slice_end;
+        U64 slice_node_end = 0;  // 0 if the slice is only limited by time
+        board_state sliced_board;
+        search_limits sliced_limits;
+        int sliced_evaluation = invalid_evaluation;
+        bool sliced_search_abandoned = false;
+
+        time_manager::TimeManager timer;
+        std::atomic<bool> stop_search{false};  // set by the time check or from outside by stop()
+        static const int time_check_interval = 2048;  // nodes between clock reads, must be a power of two
+
+        // zobrist hashes of the game positions before the root followed by the positions on the search path
+        static const int max_game_ply = 1024;
+        array<U64, max_game_ply + max_ply> hash_history{};
+        int game_length = 0;
+
+        array<array<unsigned int, max_ply>, 2> killer_moves{};
+        array<array<unsigned int, 12>, 64> history_moves{};
+
         const int best_move_bonus = 100000;
         const int non_quiet_bonus = 10000;
         const int first_killer_bonus = 9000;
         const int second_killer_bonus = 8000;
+        const int bad_capture_penalty = -non_quiet_bonus;  // captures losing material are tried after the quiet moves
 
-        int delta_cutoff = material_score[4];
+        const int see_quiet_margin = 50;  // quiet moves losing more than this times depth are skipped at shallow depths
+        const int see_pruning_depth = 3;
+
+        evaluation_parameters parameters = default_parameters;
 
         const array<int, 64> mirror_score =
         {
@@ -78,68 +162,6 @@ class Engine {
             a7, b7, c7, d7, e7, f7, g7, h7,
             a8, b8, c8, d8, e8, f8, g8, h8
         };
-
-        const array<array<int, 64>, 6> mg_table = {{
-            {
-                0,   0,   0,   0,   0,   0,  0,   0,
-                98, 134,  61,  95,  68, 126, 34, -11,
-                -6,   7,  26,  31,  65,  56, 25, -20,
-                -14,  13,   6,  21,  23,  12, 17, -23,
-                -27,  -2,  -5,  12,  17,   6, 10, -25,
-                -26,  -4,  -4, -10,   3,   3, 33, -12,
-                -35,  -1, -20, -23, -15,  24, 38, -22,
-                0,   0,   0,   0,   0,   0,  0,   0,
-            },
-            {
-                -167, -89, -34, -49,  61, -97, -15, -107,
-                -73, -41,  72,  36,  23,  62,   7,  -17,
-                -47,  60,  37,  65,  84, 129,  73,   44,
-                -9,  17,  19,  53,  37,  69,  18,   22,
-                -13,   4,  16,  13,  28,  19,  21,   -8,
-                -23,  -9,  12,  10,  19,  17,  25,  -16,
-                -29, -53, -12,  -3,  -1,  18, -14,  -19,
-                -105, -21, -58, -33, -17, -28, -19,  -23,
-            },
-            {
-                -29,   4, -82, -37, -25, -42,   7,  -8,
-                -26,  16, -18, -13,  30,  59,  18, -47,
-                -16,  37,  43,  40,  35,  50,  37,  -2,
-                -4,   5,  19,  50,  37,  37,   7,  -2,
-                -6,  13,  13,  26,  34,  12,  10,   4,
-                0,  15,  15,  15,  14,  27,  18,  10,
-                4,  15,  16,   0,   7,  21,  33,   1,
-                -33,  -3, -14, -21, -13, -12, -39, -21,
-            },
-            {
-                32,  42,  32,  51, 63,  9,  31,  43,
-                27,  32,  58,  62, 80, 67,  26,  44,
-                -5,  19,  26,  36, 17, 45,  61,  16,
-                -24, -11,   7,  26, 24, 35,  -8, -20,
-                -36, -26, -12,  -1,  9, -7,   6, -23,
-                -45, -25, -16, -17,  3,  0,  -5, -33,
-                -44, -16, -20,  -9, -1, 11,  -6, -71,
-                -19, -13,   1,  17, 16,  7, -37, -26,
-            },
-            {
-                -28,   0,  29,  12,  59,  44,  43,  45,
-                -24, -39,  -5,   1, -16,  57,  28,  54,
-                -13, -17,   7,   8,  29,  56,  47,  57,
-                -27, -27, -16, -16,  -1,  17,  -2,   1,
-                -9, -26,  -9, -10,  -2,  -4,   3,  -3,
-                -14,   2, -11,  -2,  -5,   2,  14,   5,
-                -35,  -8,  11,   2,   8,  15,  -3,   1,
-                -1, -18,  -9,  10, -15, -25, -31, -50,
-            },
-            {
-                -65,  23,  16, -15, -56, -34,   2,  13,
-                29,  -1, -20,  -7,  -8,  -4, -38, -29,
-                -9,  24,   2, -16, -20,   6,  22, -22,
-                -17, -20, -12, -27, -30, -25, -14, -36,
-                -49,  -1, -27, -39, -46, -44, -33, -51,
-                -14, -14, -22, -46, -44, -30, -15, -27,
-                1,   7,  -8, -64, -43, -16,   9,   8,
-                -15,  36,  12, -54,   8, -28,  24,  14,
-            }}};
 };
 
 #endif  // engine_functions
@@ -0,0 +1,26 @@
+#ifndef evaluation_parameter_set
+#define evaluation_parameter_set
+
+#include <array>
+#include <algorithm>
+
+using std::array;
+
+
+// the numbers behind the evaluation and the capture ordering. the defaults are generated by the
+// tuner into defaultParameters.h, an engine can be given other values for tuning and testing
+struct evaluation_parameters {
+    array<int, 6> material;  // pawn to king, the kings are always on the board and count nothing
+    array<array<int, 64>, 6> piece_square;  // from the view of white, a8 first, mirrored for black
+    array<int, 6> mobility;  // per square attacked by a piece and not occupied by an own piece
+    int king_zone_attack;  // per attacked square around the enemy king
+    array<array<int, 6>, 6> mvv_lva;  // capture ordering by attacker and victim, not tuned
+
+    // the mobility and king zone terms are off by default. tuned weights are only checked in after a match against the current ones
+    bool uses_attack_terms() const
+    {
+        return king_zone_attack != 0 || std::ranges::any_of(mobility, [](int weight) { return weight != 0; });
+    }
+};
+
+#endif  // evaluation_parameter_set
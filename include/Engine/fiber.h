@@ -0,0 +1,62 @@
+#ifndef fibers
+#define fibers
+
+#include <vector>
+#include <cstddef>
+#include <memory>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/fiber.h>
+#else
+#include <ucontext.h>
+#endif
+
+using std::vector;
+
+
+namespace fiber
+{
+    // a stackful coroutine, used to suspend a running search and continue it later from the same point.
+    // natively it is built on ucontext, in the browser on emscripten fibers, which need -sASYNCIFY.
+    // a fiber may be resumed by a different thread than the one that suspended it, and ucontext does not switch
+    // the thread pointer, so code running in a fiber must not keep thread_local state or its address across a yield.
+    // the search has none, errno and the like simply belong to the thread resuming it.
+    // a fiber has to run to its end before it is destroyed, its stack is freed without unwinding the frames on it
+    class Fiber {
+        public:
+            // the search needs about 60 KB at a selective depth of 37 and its depth is limited to 64 plies,
+            // so this leaves room for frames of unoptimized builds
+            static const size_t default_stack_size = 512 * 1024;
+
+            void set_stack_size(size_t bytes);  // used from the next start()
+            void start(void (*entry)(void *), void *argument);  // prepares the fiber, it runs on the first resume()
+            void resume();  // runs the fiber until it yields or returns
+            void yield();  // called from inside the fiber, returns to the caller of resume()
+            bool running();  // started and not yet returned
+
+        private:
+            static void trampoline(void *fiber);
+
+            void (*entry)(void *) = nullptr;
+            void *argument = nullptr;
+            bool started = false;
+            bool finished = false;
+
+            size_t stack_size = default_stack_size;
+            size_t allocated_stack_size = 0;
+            std::unique_ptr<char[]> stack;  // not zeroed, so that many suspended searches only use the memory they touch
+#ifdef __EMSCRIPTEN__
+            static const size_t asyncify_stack_size = 256 * 1024;
+            vector<char> asyncify_stack;
+            vector<char> caller_asyncify_stack;
+            emscripten_fiber_t context;
+            emscripten_fiber_t caller_context;
+#else
+            static void ucontext_trampoline(unsigned int high, unsigned int low);
+            ucontext_t context;
+            ucontext_t caller_context;
+#endif
+    };
+}
+
+#endif  // fibers
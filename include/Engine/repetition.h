@@ -0,0 +1,29 @@
+#ifndef repetition_detection
+#define repetition_detection
+
+#include "utils.h"
+#include "Board/board.h"
+
+#include <array>
+#include <span>
+
+using board::board_state;
+using std::array;
+using std::span;
+
+
+namespace repetition
+{
+    // cuckoo tables of the zobrist differences of all reversible piece moves on an empty board
+    constexpr int cuckoo_size = 8192;
+    extern array<U64, cuckoo_size> cuckoo_keys;
+    extern array<unsigned int, cuckoo_size> cuckoo_moves;
+
+    void init_cuckoo_tables();
+
+    // history contains the zobrist hashes of the earlier positions ending with the current one
+    bool is_repetition(board_state &board, span<const U64> history, int depth_from_root);
+    bool has_upcoming_repetition(board_state &board, span<const U64> history, int depth_from_root);
+}
+
+#endif  // repetition_detection
@@ -0,0 +1,96 @@
+#ifndef search_scheduling
+#define search_scheduling
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "engineContext.h"
+#include "Engine/engine.h"
+#include "Engine/transpositionTable.h"
+
+using std::string;
+using std::vector;
+using time_manager::search_limits;
+using transposition_table::TranspositionTable;
+
+
+namespace search_scheduler
+{
+    struct search_outcome {
+        int id;
+        unsigned int best_move;
+        unsigned int ponder_move;
+        int evaluation;
+        U64 nodes;
+        int slices;  // number of times the search was resumed
+        int queue_milli_seconds;  // from submission to the first slice
+        int total_milli_seconds;  // from submission to the result
+        bool stopped = false;  // the scheduler was destroyed first, the moves are the best found so far or 0
+    };
+
+    struct search_task {
+        string fen;
+        vector<string> moves;  // played from the fen, in uci notation
+        search_limits limits;  // a move time counts from the submission, so it works as a deadline
+        int priority = 1;  // share of the cpu relative to the other searches
+        int multi_pv = 1;
+        info_callback on_info;  // optional, called from a worker thread
+        std::function<void(const search_outcome &)> on_finished;  // called from a worker thread
+    };
+
+    // runs many searches on a few threads. every search is suspended after a slice of nodes and the
+    // workers always continue the search with the least nodes per priority so far, so a long search
+    // can not hold up the short ones. searches past their deadline go first, to deliver their result.
+    // a search is not pinned to a worker, any worker may continue its fiber (see fiber.h for what that allows)
+    class SearchScheduler {
+        public:
+            SearchScheduler(int workers, std::shared_ptr<TranspositionTable> shared_table, U64 slice_nodes = default_slice_nodes);
+            ~SearchScheduler();
+            int submit(search_task task);  // returns the id of the search, or -1 if the position or a move is invalid or after shutdown
+            void shutdown();  // answers the unfinished searches as stopped and stops the workers, called by the destructor
+            void wait_until_idle();
+
+            static const U64 default_slice_nodes = 16384;
+
+        private:
+            struct scheduled_search {
+                int id;
+                search_task task;
+                std::unique_ptr<EngineContext> context;
+                std::chrono::time_point<std::chrono::steady_clock> submitted;
+                std::chrono::time_point<std::chrono::steady_clock> deadline;
+                bool has_deadline = false;
+                bool started = false;
+                int slices = 0;
+                int queue_milli_seconds = 0;
+                double virtual_nodes = 0;  // nodes divided by the priority
+            };
+
+            void worker_loop();
+            search_outcome outcome_of(scheduled_search &search, bool stopped);
+            std::unique_ptr<scheduled_search> pick_next();  // called with the mutex held
+            std::unique_ptr<EngineContext> take_context();
+
+            std::shared_ptr<TranspositionTable> table;
+            U64 slice_nodes;
+
+            std::mutex mutex;
+            std::condition_variable work_available;
+            std::condition_variable idle;
+            vector<std::unique_ptr<scheduled_search>> runnable;
+            vector<std::unique_ptr<EngineContext>> spare_contexts;  // reused, the engines are costly to set up
+            int running = 0;
+            int next_id = 0;
+            double virtual_time = 0;  // virtual nodes of the last search given a slice
+            bool shutting_down = false;
+            vector<std::thread> workers;
+    };
+}
+
+#endif  // search_scheduling
@@ -0,0 +1,50 @@
+#ifndef time_management
+#define time_management
+
+#include <chrono>
+#include <atomic>
+
+
+namespace time_manager
+{
+    struct search_limits {
+        int time_left = -1;  // milliseconds left on our clock, -1 if not playing with a clock
+        int increment = 0;  // increment per move in milliseconds
+        int moves_to_go = 0;  // moves until the next time control, 0 for sudden death
+        int move_time = -1;  // fixed time for this move in milliseconds, -1 if not used
+        int depth = -1;  // maximum search depth, -1 if not used
+        long long nodes = -1;  // maximum number of nodes searched by all threads, -1 if not used
+        bool ponder = false;  // searching on the opponent's time, the limits apply after ponder_hit()
+    };
+
+    class TimeManager {
+        public:
+            void start(const search_limits &limits);
+            void update(int depth, unsigned int best_move, int evaluation);
+            bool soft_limit_reached();
+            bool hard_limit_reached();
+            void ponder_hit();
+            int elapsed_milli_seconds();
+
+        private:
+            std::chrono::time_point<std::chrono::steady_clock> start_time;
+            std::chrono::time_point<std::chrono::steady_clock> ponder_hit_time;  // the hard limit is measured from here
+            std::atomic<bool> pondering{false};  // cleared from the front-end thread by ponder_hit()
+            bool pondered = false;
+            bool limited = false;
+            bool fixed_time = false;  // a fixed move time is not scaled
+            int soft_limit = 0;  // do not start a new iteration after this
+            int hard_limit = 0;  // abort the search after this
+            int scaled_soft_limit = 0;  // soft limit adjusted for the best move stability and score drops
+
+            unsigned int previous_best_move = 0;
+            int previous_evaluation = 0;
+            int best_move_stability = 0;  // number of consecutive iterations with the same best move
+
+            const int move_overhead = 30;  // time reserved for communication with the front-end
+            const int default_moves_to_go = 30;  // expected number of moves left in sudden death
+            const int max_moves_to_go = 50;
+    };
+}
+
+#endif  // time_management
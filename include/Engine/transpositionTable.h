@@ -3,18 +3,49 @@
 
 #include "utils.h"
 #include <array>
+#include <atomic>
+#include <memory>
+#include <string>
 
-using random_numbers::random_64_bit_number;
 using std::array;
+using std::string;
 
+// the keys are generated at compile time by splitmix64 from a fixed seed, so that they are the same in
+// every build and on every platform. files keyed by zobrist hashes, like opening books and position
+// indexes, stay valid from one build to the next
 namespace zobrist
 {
-    extern array<array<U64, 12>, 64> zobrist_pieces;
-    extern U64 zobrist_side;
-    extern array<U64, 16> zobrist_castle;
-    extern array<U64, 64> zobrist_enpassant;
-    
-    void init_zobrist_keys();
+    constexpr U64 splitmix64(U64 &state)
+    {
+        U64 number = (state += 0x9e3779b97f4a7c15ULL);
+        number = (number ^ (number >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        number = (number ^ (number >> 27)) * 0x94d049bb133111ebULL;
+        return number ^ (number >> 31);
+    }
+
+    struct zobrist_keys {
+        array<array<U64, 64>, 12> pieces{};
+        U64 side = 0;
+        array<U64, 16> castle{};
+        array<U64, 64> enpassant{};
+    };
+
+    constexpr zobrist_keys generate_zobrist_keys(U64 seed)
+    {
+        zobrist_keys keys;
+        for (array<U64, 64> &piece : keys.pieces)
+            for (U64 &key : piece) key = splitmix64(seed);
+        for (U64 &key : keys.castle) key = splitmix64(seed);
+        for (U64 &key : keys.enpassant) key = splitmix64(seed);
+        keys.side = splitmix64(seed);
+        return keys;
+    }
+
+    inline constexpr zobrist_keys keys = generate_zobrist_keys(0x5a6f627269737431ULL);
+    inline constexpr const array<array<U64, 64>, 12> &zobrist_pieces = keys.pieces;
+    inline constexpr const U64 &zobrist_side = keys.side;
+    inline constexpr const array<U64, 16> &zobrist_castle = keys.castle;
+    inline constexpr const array<U64, 64> &zobrist_enpassant = keys.enpassant;
 }
 
 namespace transposition_table
@@ -28,14 +59,41 @@ namespace transposition_table
         int node_type;
         int evaluation;
     };
-    constexpr size_t max_size_mb = 64;
+    // the entry is packed into one word and the key is stored xored with it, so that an entry torn
+    // by two search threads writing at the same time fails the key check instead of being used
+    struct table_slot
+    {
+        std::atomic<U64> key;
+        std::atomic<U64> data;
+    };
+    constexpr size_t default_size_mb = 128;  // both tables together
     constexpr size_t bytes_per_mb = 1024 * 1024;
-    constexpr size_t array_size = (max_size_mb * bytes_per_mb) / sizeof(transposition_table_entry);
-    extern array<transposition_table_entry, array_size> shallow_tt_table;
-    extern array<transposition_table_entry, array_size> deep_tt_table;
 
-    void add_move_to_table(U64 zobrist_hash, U64 move, int depth, int node_type, int evaluation);
-    int get_evaluation_from_table(U64 zobrist_hash, int depth, int alpha, int beta);
+    // an experience file keeps the deep entries of a table from one process or page load to the next, as
+    // pairs of the zobrist hash and the packed entry after a magic number. mate scores are left out,
+    // they are stored from the view of the root they were found from
+    constexpr U64 experience_magic = 0x3130505845534543ULL;  // "CESEXP01"
+    constexpr int experience_min_depth = 6;
+
+    // owned by an Engine, or shared by several of them through a shared_ptr, like the helpers of a parallel search
+    class TranspositionTable {
+        public:
+            TranspositionTable(size_t size_mb = default_size_mb);
+            void add_move_to_table(U64 zobrist_hash, U64 move, int depth, int node_type, int evaluation);
+            int get_evaluation_from_table(U64 zobrist_hash, int depth, int alpha, int beta);
+            unsigned int get_move_from_table(U64 zobrist_hash);
+            int hashfull();
+            void clear();
+
+            // the entries are streamed in blocks and the slots are atomic, so both can run while the table is searched
+            bool save_experience(const string &path, int min_depth = experience_min_depth);  // replaces the file when complete
+            size_t load_experience(const string &path);  // the number of entries read, kept only where they are deeper
+
+        private:
+            size_t table_size;
+            std::unique_ptr<table_slot[]> shallow_tt_table;
+            std::unique_ptr<table_slot[]> deep_tt_table;
+    };
 }
 
 
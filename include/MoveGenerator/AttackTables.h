@@ -26,6 +26,7 @@ namespace piece_attacks
     extern U64 rook_attacks_table[64][4096];
     extern U64 king_attacks_table[64];
     extern array<array<U64, 64>, 64> align_mask;
+    extern array<array<U64, 64>, 64> between_mask;
 
     U64 bishop_attack_masks(int square);
     U64 _bishop_attacks(int square, U64 blockers);
@@ -70,6 +71,7 @@ namespace piece_attacks
     void init_slider_attacks();
     void init_all_attacks();
     void _init_align_masks();
+    void _init_between_masks();
     void init_all();
 }
 
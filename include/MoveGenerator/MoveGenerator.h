@@ -16,7 +16,11 @@ using namespace constants;
 
 namespace move_generator
 {
+    const array<int, 6> see_piece_values = {100, 300, 350, 500, 1000, 0};
+
     bool is_square_attacked(int square, board_state &board);
+    U64 attackers_to(int square, U64 occupancy, board_state &board);
+    bool see(board_state &board, unsigned int move, int threshold);
     bool in_check_after_en_passant(board_state &board, int source, int enemy_pawn_location);
     void print_attacked(board_state &board);
     void print_move_list(span<unsigned int> moves);
@@ -31,9 +35,26 @@ namespace move_generator
     };
     king_info _find_check_and_pin_masks(board_state &board);
 
+    struct check_info {
+        int enemy_king = no_square;
+        array<U64, 6> check_squares = {};  // squares from which each piece type of the side to move attacks the enemy king
+        U64 discovered_check_blockers = 0ULL;  // own pieces, which uncover a slider attack on the enemy king when moved
+    };
+    check_info find_check_info(board_state &board);
+    bool gives_check(board_state &board, check_info &info, unsigned int move);
+
+    struct attack_info {
+        array<U64, 12> attacks_by_piece = {};  // squares attacked by all pieces of each type
+        array<U64, 2> attacked = {};  // squares attacked by each side, attacks of the side not to move x-ray the king of the side to move
+        array<U64, 2> king_zone = {};  // king square and its neighbours for each side
+    };
+    attack_info find_attack_info(board_state &board);
+    bool in_check(board_state &board, attack_info &attack_map);
+
     span<unsigned int> generate_moves(board_state &board, array<unsigned int, 218> &move_list, bool no_quiet_moves);
+    span<unsigned int> generate_moves(board_state &board, array<unsigned int, 218> &move_list, bool no_quiet_moves, attack_info &attack_map);
     void _generate_pawn_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index);
-    void _generate_king_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index);
+    void _generate_king_moves(board_state &board, attack_info &attack_map, bool no_quiet_moves, span<unsigned int> moves, int &move_index);
     void _generate_knight_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index);
     void _generate_slider_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index);
 }
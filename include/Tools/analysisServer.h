@@ -0,0 +1,44 @@
+#ifndef analysis_server_tool
+#define analysis_server_tool
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+
+// serves analysis requests over a local socket. the searches of all connections are multiplexed on a
+// fixed number of worker threads by a search scheduler, and the engines are reused between requests.
+// one json object per line in both directions:
+//   {"id": 1, "fen": "...", "moves": ["e2e4", "e7e5"], "movetime": 1000, "depth": 20, "nodes": 1000000, "multipv": 3, "priority": 2}
+// is answered by a line {"id": 1, "type": "info", ...} for every completed line of every iteration
+// and finally {"id": 1, "type": "bestmove", "bestmove": "g1f3", "ponder": "b8c6"}, or {"id": 1, "type": "error", ...}.
+// a search cut short by the server shutting down is answered with "stopped": true in its bestmove line.
+// SIGINT or SIGTERM shut the server down, and a connection above the limit gets an error line and is closed
+namespace analysis_server
+{
+    struct server_options {
+        int port = 8765;  // tcp port on the loopback interface, used if no socket path is given
+        string socket_path;  // unix domain socket
+        int workers = 4;  // threads searching at the same time, any number of searches share them
+        int hash_mb = 128;  // size of the transposition table shared by all searches
+        int max_connections = 64;  // every connection has its own thread, which mostly waits for its searches
+    };
+
+    struct analysis_request {
+        string id = "null";  // a json string or number, echoed back as it was sent
+        string fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+        vector<string> moves;
+        int move_time = -1;
+        int depth = -1;
+        long long nodes = -1;
+        int multi_pv = 1;
+        int priority = 1;  // share of the workers relative to the other searches
+    };
+
+    bool parse_request(const string &line, analysis_request &request, string &error);
+    int run(const server_options &options);  // returns 0 after a shutdown signal, 1 if the socket cannot be opened
+}
+
+#endif  // analysis_server_tool
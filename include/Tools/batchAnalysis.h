@@ -0,0 +1,31 @@
+#ifndef batch_analysis_tool
+#define batch_analysis_tool
+
+#include <string>
+
+using std::string;
+
+
+// analyses a file of positions on a pool of worker threads, each with an engine of its own.
+// every input line is an epd record or a fen, optionally followed by epd operations of which only
+// an id is kept. every position gets one output line, in the order of the input:
+//   <position> bm e2e4; ce 35; acd 10; acn 123456; pv e2e4 e7e5; id "a";
+// with dm instead of ce for a mate and the moves in uci notation, dm 0 if the side to move is mated
+// and ce 0 for a stalemate. every position is searched from empty tables, so the results do not depend
+// on the order of the input or the number of threads. invalid lines are answered with
+//   <line> ; error "invalid position";
+namespace batch_analysis
+{
+    struct batch_options {
+        string input_path;  // standard input if empty
+        string output_path;  // standard output if empty
+        int threads = 0;  // one per core if 0
+        int depth = -1;
+        long long nodes = -1;
+        int hash_mb = 16;  // per worker, small tables keep the workers from competing for memory
+    };
+
+    int run(const batch_options &options);
+}
+
+#endif  // batch_analysis_tool
@@ -0,0 +1,47 @@
+#ifndef data_generator_tool
+#define data_generator_tool
+
+#include <string>
+#include <cstdint>
+
+#include "utils.h"
+#include "Board/board.h"
+
+using std::string;
+using board::board_state;
+
+
+// generates training data by self-play. every thread plays games of fixed node searches from a few
+// random opening moves and records the quiet positions with the search score and the game result.
+// the records go to shard files, written by a thread of their own so that the searches never wait for the disk
+namespace data_generator
+{
+    // 32 bytes per position, stored in the byte order of the machine
+    struct training_record {
+        board::packed_board position;
+        int16_t score;  // of the search, for the side to move
+        uint16_t fullmove_number;
+        uint8_t halfmove_clock;
+        uint8_t result;  // 0 if black won, 1 for a draw, 2 if white won
+        uint8_t unused[2];
+    };
+    static_assert(sizeof(training_record) == 32, "training records are written as they are in memory");
+
+    training_record pack_record(const board_state &board, int score, int result);
+    board_state unpack_record(const training_record &record);
+
+    struct generator_options {
+        string output_prefix = "data";  // the shards are written to <prefix>_<shard>.bin
+        int threads = 0;  // one per core if 0
+        int shards = 0;  // one per thread if 0
+        U64 positions = 1000000;  // stops after this many records
+        long long nodes = 5000;  // per move
+        int random_plies = 8;  // random moves at the start of every game
+        int hash_mb = 16;  // per thread
+        U64 seed = 0;
+    };
+
+    int run(const generator_options &options);
+}
+
+#endif  // data_generator_tool
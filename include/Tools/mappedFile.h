@@ -0,0 +1,30 @@
+#ifndef mapped_file_tool
+#define mapped_file_tool
+
+#include <string>
+#include <string_view>
+
+using std::string;
+
+
+// a read only file mapped into memory, so that files larger than the memory can be read
+// without copying them. the pages are loaded by the system as they are touched
+class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+        ~MappedFile();
+
+        bool open(const string &path, bool sequential = true);  // sequential hints the system to read ahead
+        void close();
+        const char *data() const { return mapping; }
+        size_t size() const { return length; }
+        std::string_view contents() const { return std::string_view(mapping, length); }
+
+    private:
+        char *mapping = nullptr;
+        size_t length = 0;
+};
+
+#endif  // mapped_file_tool
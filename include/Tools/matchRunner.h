@@ -0,0 +1,65 @@
+#ifndef match_runner_tool
+#define match_runner_tool
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+using std::string;
+using std::vector;
+
+
+// plays games between two uci engines, usually two builds or two configurations of this one,
+// several games at a time. every opening is played twice with the colours swapped. the result is
+// given in elo with a 95% confidence interval and, if bounds are given, as a sequential
+// probability ratio test, which ends the match as soon as it accepts one of its hypotheses
+namespace match_runner
+{
+    struct engine_options {
+        string command;  // run by the shell
+        vector<std::pair<string, string>> options;  // sent with setoption before the first game
+    };
+
+    struct match_options {
+        engine_options engines[2];
+        string openings_path;  // epd or fen lines, the start position if empty
+        string pgn_path;  // the games are written here if given
+        int games = 100;
+        int concurrency = 1;  // games played at the same time, each engine process uses one thread
+        int base_milli_seconds = 10000;  // time control, time for the game and increment per move
+        int increment_milli_seconds = 100;
+        int time_margin_milli_seconds = 100;  // allowed beyond the clock before the game is lost on time
+
+        // a game is adjudicated as won when both engines agree on the score for resign_moves moves,
+        // and drawn when both scores stay within draw_score centipawns for draw_moves moves after draw_start
+        int resign_score = 1000;
+        int resign_moves = 3;
+        int draw_score = 10;
+        int draw_moves = 8;
+        int draw_start = 40;
+
+        bool sprt = false;
+        double elo0 = 0;
+        double elo1 = 5;
+        double alpha = 0.05;
+        double beta = 0.05;
+    };
+
+    struct match_result {
+        int wins = 0;  // of the first engine
+        int draws = 0;
+        int losses = 0;
+    };
+
+    struct elo_estimate {
+        double elo;
+        double error;  // half the width of the 95% confidence interval
+    };
+
+    elo_estimate estimate_elo(const match_result &result);
+    double log_likelihood_ratio(const match_result &result, double elo0, double elo1);
+    int run(const match_options &options);
+}
+
+#endif  // match_runner_tool
@@ -0,0 +1,70 @@
+#ifndef opening_book_tool
+#define opening_book_tool
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <random>
+
+#include "utils.h"
+#include "Board/board.h"
+#include "Tools/mappedFile.h"
+
+using std::string;
+using std::vector;
+using std::span;
+using board::board_state;
+
+
+// opening books built from game collections. a book file is a header followed by entries sorted by
+// zobrist key and move, so that it can be memory mapped and searched without loading it. the numbers
+// are stored in the byte order of the machine, the magic number does not match on the other order
+namespace opening_book
+{
+    const U64 book_magic = 0x324b4f4f42534543ULL;  // "CESBOOK2", the first version was keyed by the random zobrist keys
+
+    struct book_header {
+        U64 magic;
+        U64 n_entries;
+    };
+
+    struct book_entry {
+        U64 key;
+        uint32_t move;  // in the packed format of the engine
+        uint32_t games;
+        uint32_t wins;  // for the side playing the move
+        uint32_t draws;
+    };
+    static_assert(sizeof(book_entry) == 24, "book entries are stored as they are in memory");
+
+    struct build_options {
+        vector<string> input_paths;  // pgn files
+        string output_path;
+        int threads = 0;  // one per core if 0
+        int max_ply = 30;  // only moves played before this ply enter the book
+        int min_games = 3;  // moves played less often are left out
+        double min_score = 0;  // moves scoring less for the side playing them are left out, from 0 to 1
+        size_t memory_mb = 1024;  // the statistics are spilled to disk beyond this size
+    };
+
+    int build(const build_options &options);
+
+    class OpeningBook {
+        public:
+            bool open(const string &path);
+            span<const book_entry> find(U64 key) const;  // the entries of a position, sorted by move
+            // a legal book move, or 0. the first returns the most played move, the second chooses as often as a move
+            // was played with a generator of the caller, so that threads probing one book do not share a state
+            unsigned int probe(board_state &board) const;
+            unsigned int probe(board_state &board, std::mt19937_64 &random) const;
+
+        private:
+            vector<const book_entry *> legal_entries(board_state &board, U64 &total_games) const;
+
+            MappedFile file;
+            span<const book_entry> entries;
+    };
+}
+
+#endif  // opening_book_tool
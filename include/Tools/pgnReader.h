@@ -0,0 +1,54 @@
+#ifndef pgn_reader_tool
+#define pgn_reader_tool
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+
+#include "utils.h"
+#include "Board/board.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using board::board_state;
+
+
+// reads games in portable game notation and replays them. files are memory mapped and split into
+// chunks at game boundaries, which are parsed on all cores. comments, variations and annotations
+// are skipped, only the main line is replayed
+namespace pgn_reader
+{
+    struct pgn_game {
+        vector<std::pair<string_view, string_view>> tags;  // name and value, as written in the file
+        string_view result;  // the termination marker, empty if the game has none
+        vector<unsigned int> moves;
+        vector<board_state> positions;  // the start position, then the position after each move
+        const char *error = nullptr;  // why the game could not be replayed completely, the moves before it are kept
+        size_t offset = 0;  // where the game starts in the text it was read from
+
+        string_view tag(string_view name) const;  // empty if the game has no such tag
+        void clear();
+    };
+
+    struct read_statistics {
+        U64 games = 0;
+        U64 positions = 0;
+        U64 invalid_games = 0;
+        U64 bytes = 0;
+        double seconds = 0;
+    };
+
+    // called from the reading threads at the same time, thread is the index of the calling thread.
+    // games arrive in no particular order and the game is only valid during the call
+    typedef std::function<void(const pgn_game &game, int thread)> game_callback;
+
+    unsigned int parse_san(board_state &board, string_view san);  // 0 if the move is not legal or ambiguous
+    string move_to_san(board_state &board, unsigned int move);  // the move has to be legal
+    size_t read_game(string_view text, size_t position, pgn_game &game);  // returns the position after the game
+    read_statistics read_games(string_view text, int threads, const game_callback &callback);
+    bool read_file(const string &path, int threads, const game_callback &callback, read_statistics &statistics);
+}
+
+#endif  // pgn_reader_tool
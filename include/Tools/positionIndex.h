@@ -0,0 +1,73 @@
+#ifndef position_index_tool
+#define position_index_tool
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "utils.h"
+#include "Tools/mappedFile.h"
+
+using std::string;
+using std::vector;
+using std::span;
+
+
+// an index from the positions of game collections to the games reaching them. an index file is a header,
+// the entries sorted by zobrist key and game, and the list of the pgn files with how much of each has been
+// indexed. adding games merges the new entries into a new file, and files that have grown since the last
+// update are read from where it stopped. the numbers are stored in the byte order of the machine
+namespace position_index
+{
+    const U64 index_magic = 0x3158444e49534543ULL;  // "CESINDX1"
+
+    struct index_header {
+        U64 magic;
+        U64 n_entries;
+        U64 n_files;
+        U64 files_offset;  // of the file list, after the entries
+    };
+
+    struct index_entry {
+        U64 key;
+        U64 game;  // the file in the top 16 bits and the offset of the game in it in the others
+        uint32_t move;  // played from the position in the packed format of the engine, 0 at the end of the game
+        uint16_t ply;
+        uint8_t result;  // 0 if black won, 1 for a draw, 2 if white won, 3 if the game has no result
+        uint8_t unused;
+    };
+    static_assert(sizeof(index_entry) == 24, "index entries are stored as they are in memory");
+
+    inline int game_file(U64 game) { return game >> 48; }
+    inline U64 game_offset(U64 game) { return game & ((1ULL << 48) - 1); }
+
+    struct indexed_file {
+        string path;
+        U64 indexed_bytes;  // the games before this offset are in the index
+    };
+
+    struct index_options {
+        string index_path;
+        vector<string> input_paths;  // pgn files
+        int threads = 0;  // one per core if 0
+        int max_ply = 0;  // positions after this ply are left out, none if 0
+    };
+
+    int update(const index_options &options);  // creates the index if it does not exist
+
+    class PositionIndex {
+        public:
+            bool open(const string &path);
+            span<const index_entry> find(U64 key) const;  // the entries of a position, sorted by game
+            span<const index_entry> all() const { return entries; }
+            const vector<indexed_file> &files() const { return file_list; }
+
+        private:
+            MappedFile file;
+            span<const index_entry> entries;
+            vector<indexed_file> file_list;
+    };
+}
+
+#endif  // position_index_tool
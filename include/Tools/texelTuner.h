@@ -0,0 +1,38 @@
+#ifndef texel_tuner_tool
+#define texel_tuner_tool
+
+#include <string>
+#include <vector>
+
+#include "Engine/evaluationParameters.h"
+
+using std::string;
+using std::vector;
+
+
+// tunes the evaluation parameters on positions labelled with the result of their game, by minimising
+// the squared error between the result and the evaluation mapped to an expected score by a sigmoid.
+// the evaluation is linear in its parameters, so every position is reduced once to the counts of each
+// parameter and the loss and its gradient are sums of short dot products, split between threads that
+// are started once for the run. the counts are stored by column, so that most of the work is plain loops.
+// input lines are a fen or epd record followed by the result, as 1-0, 0-1, 1/2-1/2 or [1.0], [0.5], [0.0]
+namespace texel_tuner
+{
+    struct tuner_options {
+        vector<string> input_paths;
+        string output_path = "defaultParameters.h";  // the generated header, to replace include/Engine/defaultParameters.h
+        int threads = 0;  // one per core if 0
+        int epochs = 500;
+        double learning_rate = 1;  // in centipawns, for adam
+        double scaling = 0;  // of the sigmoid, fitted to the positions before tuning if 0
+    };
+
+    const int n_parameters = 5 + 6 * 64 + 4 + 1;  // material without the king, piece square tables, mobility, king zone
+
+    int &parameter(evaluation_parameters &parameters, int index);
+    string parameter_name(int index);
+    string to_header(const evaluation_parameters &parameters);
+    int run(const tuner_options &options);
+}
+
+#endif  // texel_tuner_tool
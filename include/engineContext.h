@@ -0,0 +1,34 @@
+#ifndef engine_context_object
+#define engine_context_object
+
+#include <string>
+#include <memory>
+
+#include "Board/board.h"
+#include "Engine/engine.h"
+#include "Engine/transpositionTable.h"
+
+using std::string;
+using board::board_state;
+using transposition_table::TranspositionTable;
+
+
+// one game: its position, the positions played before it and the engine searching it.
+// contexts do not share any mutable state unless they are given the same transposition table,
+// so any number of them can be used from different threads at the same time
+class EngineContext {
+    public:
+        EngineContext();
+        EngineContext(std::shared_ptr<TranspositionTable> shared_table);
+        bool set_position(const string &fen);  // false if the fen is not valid, the position is kept then
+        bool set_position(const string &fen, board_utils::fen_error &error);
+        bool play_move(const string &move);  // a move in uci notation, false if it is not legal
+        board_state& position();
+        Engine& engine();
+
+    private:
+        board_state board;
+        std::unique_ptr<Engine> search_engine;  // the search tables are large, so they are kept on the heap
+};
+
+#endif  // engine_context_object
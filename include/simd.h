@@ -0,0 +1,61 @@
+#ifndef simd_utils
+#define simd_utils
+
+#include "utils.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+
+// pairs of bitboards processed together, usually the same bitboard for white and black.
+// built with -msimd128 these map to wasm v128 instructions, otherwise to plain scalar code
+namespace simd
+{
+#ifdef __wasm_simd128__
+    typedef v128_t u64x2;
+
+    inline u64x2 make(U64 low, U64 high) { return wasm_u64x2_make(low, high); }
+    inline u64x2 splat(U64 value) { return wasm_u64x2_splat(value); }
+    inline u64x2 load(const U64 *pair) { return wasm_v128_load(pair); }
+    inline void store(U64 *pair, u64x2 value) { wasm_v128_store(pair, value); }
+    inline U64 low(u64x2 value) { return wasm_u64x2_extract_lane(value, 0); }
+    inline U64 high(u64x2 value) { return wasm_u64x2_extract_lane(value, 1); }
+
+    inline u64x2 bit_or(u64x2 a, u64x2 b) { return wasm_v128_or(a, b); }
+    inline u64x2 bit_and(u64x2 a, u64x2 b) { return wasm_v128_and(a, b); }
+    inline u64x2 bit_xor(u64x2 a, u64x2 b) { return wasm_v128_xor(a, b); }
+    inline u64x2 and_not(u64x2 a, u64x2 b) { return wasm_v128_andnot(a, b); }  // a & ~b
+    inline u64x2 equal(u64x2 a, u64x2 b) { return wasm_i64x2_eq(a, b); }  // all ones in the equal lanes
+
+    inline u64x2 count_bits(u64x2 value)
+    {
+        // byte counts summed pairwise up to 32 bit lanes, then the two halves of each 64 bit lane
+        u64x2 counts = wasm_u32x4_extadd_pairwise_u16x8(wasm_u16x8_extadd_pairwise_u8x16(wasm_i8x16_popcnt(value)));
+        counts = wasm_i32x4_add(counts, wasm_u64x2_shr(counts, 32));
+        return wasm_v128_and(counts, wasm_u64x2_splat(0xffffffffULL));
+    }
+#else
+    struct u64x2 { U64 lanes[2]; };
+
+    inline u64x2 make(U64 low, U64 high) { return {{low, high}}; }
+    inline u64x2 splat(U64 value) { return {{value, value}}; }
+    inline u64x2 load(const U64 *pair) { return {{pair[0], pair[1]}}; }
+    inline void store(U64 *pair, u64x2 value) { pair[0] = value.lanes[0]; pair[1] = value.lanes[1]; }
+    inline U64 low(u64x2 value) { return value.lanes[0]; }
+    inline U64 high(u64x2 value) { return value.lanes[1]; }
+
+    inline u64x2 bit_or(u64x2 a, u64x2 b) { return {{a.lanes[0] | b.lanes[0], a.lanes[1] | b.lanes[1]}}; }
+    inline u64x2 bit_and(u64x2 a, u64x2 b) { return {{a.lanes[0] & b.lanes[0], a.lanes[1] & b.lanes[1]}}; }
+    inline u64x2 bit_xor(u64x2 a, u64x2 b) { return {{a.lanes[0] ^ b.lanes[0], a.lanes[1] ^ b.lanes[1]}}; }
+    inline u64x2 and_not(u64x2 a, u64x2 b) { return {{a.lanes[0] & ~b.lanes[0], a.lanes[1] & ~b.lanes[1]}}; }
+    inline u64x2 equal(u64x2 a, u64x2 b) { return {{a.lanes[0] == b.lanes[0] ? ~0ULL : 0ULL, a.lanes[1] == b.lanes[1] ? ~0ULL : 0ULL}}; }
+
+    inline u64x2 count_bits(u64x2 value)
+    {
+        return {{(U64)bitboard_utils::count_bits(value.lanes[0]), (U64)bitboard_utils::count_bits(value.lanes[1])}};
+    }
+#endif
+}
+
+#endif  // simd_utils
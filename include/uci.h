@@ -0,0 +1,22 @@
+#ifndef uci_protocol
+#define uci_protocol
+
+#include <string>
+
+#include "Board/board.h"
+
+using std::string;
+using board::board_state;
+
+
+namespace uci
+{
+    void loop();
+    string move_to_uci(unsigned int move);
+    unsigned int parse_move(board_state &board, const string &move);
+    bool is_mate_score(int evaluation);
+    int mate_distance(int evaluation);  // in moves, negative when getting mated, 0 if mated already or not a mate score
+    string score_to_uci(int evaluation);
+}
+
+#endif  // uci_protocol
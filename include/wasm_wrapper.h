@@ -1,15 +1,11 @@
-#include <string>
+#include <memory>
 
-#include "Board/board.h"
-#include "Engine/engine.h"
-
-using board_utils::parse_fen;
+#include "engineContext.h"
 
 
 namespace wrapper_state
 {
-    string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
-    board::board_state state = parse_fen(start_position);
-
-    Engine engine;
+    // the page plays a single game, created by init_engine once the module has loaded
+    std::unique_ptr<EngineContext> context;
+    const char *experience_path = "/experience/table.bin";
 }
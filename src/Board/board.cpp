@@ -2,6 +2,11 @@
 #include <string>
 #include <algorithm>
 #include <span>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
 
 #include "utils.h"
 #include "Board/board.h"
@@ -17,6 +22,8 @@ using std::cout;
 using std::endl;
 using board::board_state;
 using std::string;
+using std::string_view;
+using std::array;
 
 
 namespace board
@@ -47,6 +54,12 @@ namespace board
         }
         if (piece == K) board.castle &= 0b0011;
         else if (piece == k) board.castle &= 0b1100;
+
+        // a rook captured on its starting square takes its castling right with it
+        if (target == h1) board.castle &= ~wk;
+        else if (target == a1) board.castle &= ~wq;
+        else if (target == h8) board.castle &= ~bk;
+        else if (target == a8) board.castle &= ~bq;
         board.zobrist_hash ^= zobrist_castle[board.castle];
 
         // set piece at new location considering possible promotion
@@ -151,6 +164,11 @@ namespace board
 
         board.occupancies[both] = board.occupancies[white] | board.occupancies[black];
 
+        // update the move counters
+        if (piece == P || piece == p || taken_piece != no_piece) board.halfmove_clock = 0;
+        else board.halfmove_clock++;
+        if (board.side == black) board.fullmove_number++;
+
         // update the player to move
         board.side = board.side == white ? black : white;
         board.zobrist_hash ^= zobrist_side;
@@ -270,83 +288,318 @@ namespace board
 
 namespace board_utils
 {
-    board_state parse_fen(string fen)
+    // the meaning of every character in the placement field, looked up once per character. every character
+    // is handled the same way, a piece is set on a spare bitboard for the digits and the slashes, so that
+    // the only branches are on the rank ends and the errors
+    struct fen_character {
+        uint8_t piece;  // no_piece for an empty square or a rank end
+        uint8_t squares;  // the squares the character covers
+        uint8_t kind;
+    };
+    enum {fen_square, fen_rank_end, fen_invalid};
+    constexpr array<fen_character, 256> fen_characters = []() {
+        array<fen_character, 256> characters{};
+        characters.fill({no_piece, 0, fen_invalid});
+        const char pieces[] = "PNBRQKpnbrqk";
+        for (int piece = P; piece <= k; piece++) characters[(unsigned char)pieces[piece]] = {(uint8_t)piece, 1, fen_square};
+        for (int count = 1; count <= 8; count++) characters['0' + count] = {no_piece, (uint8_t)count, fen_square};
+        characters['/'] = {no_piece, 0, fen_rank_end};
+        return characters;
+    }();
+
+    bool is_fen_space(char character) { return character == ' ' || character == '\t' || character == '\r' || character == '\n'; }
+
+    string_view next_field(string_view fen, size_t &index)
     {
-        int fen_index = 0;
-        board_state state = board_state{};
-        
-        // update bitboards
-        int square = 0;
-        while (square < 64)
+        while (index < fen.size() && is_fen_space(fen[index])) index++;
+        size_t start = index;
+        while (index < fen.size() && !is_fen_space(fen[index])) index++;
+        return fen.substr(start, index - start);
+    }
+
+    bool parse_clock(string_view field, int &value)
+    {
+        if (field.empty() || field.size() > 9) return false;
+        value = 0;
+        for (char digit : field)
+        {
+            if (digit < '0' || digit > '9') return false;
+            value = value * 10 + (digit - '0');
+        }
+        return true;
+    }
+
+    const char *fen_error_text(fen_error error)
+    {
+        switch (error)
+        {
+            case fen_error::none: return "valid";
+            case fen_error::placement: return "invalid piece placement";
+            case fen_error::kings: return "not one king per side";
+            case fen_error::pawns: return "pawn on the first or last rank";
+            case fen_error::piece_count: return "more than 16 pieces of one side";
+            case fen_error::side: return "invalid side to move";
+            case fen_error::castling: return "invalid castling rights";
+            case fen_error::enpassant: return "invalid en passant square";
+            case fen_error::clocks: return "invalid move clocks";
+            case fen_error::trailing_text: return "text after the move clocks";
+            case fen_error::king_capturable: return "the side not to move is in check";
+        }
+        return "invalid fen";
+    }
+
+    fen_error parse_fen(string_view fen, board_state &state)
+    {
+        state = board_state{};
+        size_t index = 0;
+
+        // the pieces, rank by rank from the eighth
+        string_view placement = next_field(fen, index);
+        U64 bitboards[no_piece + 1] = {};
+        int square = 0, file = 0;
+        for (char character : placement)
         {
-            if ((fen[fen_index] >= 'a' && fen[fen_index] <= 'z') || (fen[fen_index] >= 'A' && fen[fen_index] <= 'Z'))
+            fen_character decoded = fen_characters[(unsigned char)character];
+            bitboards[decoded.piece] |= 1ULL << (square & 63);
+            square += decoded.squares;
+            file += decoded.squares;
+            if (decoded.kind != fen_square)
             {
-                char piece_char = fen[fen_index];
-                int piece = string_to_piece.at(piece_char);
-                set_bit(state.bitboards[piece], square);
-                square++;
+                if (decoded.kind == fen_invalid || file != 8 || square == 64) return fen_error::placement;
+                file = 0;
             }
-            else if (fen[fen_index] >= '0' && fen[fen_index] <= '9')
+            if (file > 8) return fen_error::placement;
+        }
+        if (square != 64 || file != 8) return fen_error::placement;
+        std::copy(bitboards, bitboards + no_piece, state.bitboards);
+        if (count_bits(state.bitboards[K]) != 1 || count_bits(state.bitboards[k]) != 1) return fen_error::kings;
+        const U64 back_ranks = 0xff000000000000ffULL;  // a8 to h8 and a1 to h1
+        if ((state.bitboards[P] | state.bitboards[p]) & back_ranks) return fen_error::pawns;
+
+        // a packed board has room for 16 pieces of each side
+        U64 white_pieces = 0, black_pieces = 0;
+        for (int piece = P; piece <= K; piece++) white_pieces |= state.bitboards[piece];
+        for (int piece = p; piece <= k; piece++) black_pieces |= state.bitboards[piece];
+        if (count_bits(white_pieces) > 16 || count_bits(black_pieces) > 16) return fen_error::piece_count;
+
+        string_view side = next_field(fen, index);
+        if (side != "w" && side != "b") return fen_error::side;
+        state.side = side == "w" ? white : black;
+
+        string_view castling = next_field(fen, index);
+        if (castling.empty() || castling.size() > 4) return fen_error::castling;
+        if (castling != "-")
+        {
+            for (char right : castling)
             {
-                int offset = fen[fen_index] - '0';
-                int current_piece = -1;
-                for (int piece = P; piece <= k; piece++)
-                {
-                    if (get_bit(state.bitboards[piece], square))
-                        current_piece = piece;
-                }
-
-                square += offset;
+                int bit = right == 'K' ? wk : right == 'Q' ? wq : right == 'k' ? bk : right == 'q' ? bq : 0;
+                if (bit == 0 || (state.castle & bit)) return fen_error::castling;
+                state.castle |= bit;
             }
-            fen_index++;
         }
-        fen_index++;
 
-        // update side to move
-        (fen[fen_index] == 'w') ? (state.side = white) : (state.side = black);
-        fen_index += 2;
+        // the square behind a pawn that has just moved two squares, so on the sixth rank if white is to move
+        string_view enpassant = next_field(fen, index);
+        state.enpassant = no_square;
+        if (enpassant != "-")
+        {
+            char rank = state.side == white ? '6' : '3';
+            if (enpassant.size() != 2 || enpassant[0] < 'a' || enpassant[0] > 'h' || enpassant[1] != rank) return fen_error::enpassant;
+            state.enpassant = (8 - (rank - '0')) * 8 + (enpassant[0] - 'a');
+        }
 
-        // update castling rights
-        while (fen[fen_index] != ' ')
+        // the halfmove clock and the fullmove counter are optional
+        state.halfmove_clock = 0;
+        state.fullmove_number = 1;
+        string_view halfmove = next_field(fen, index);
+        if (!halfmove.empty())
+        {
+            if (!parse_clock(halfmove, state.halfmove_clock)) return fen_error::clocks;
+            string_view fullmove = next_field(fen, index);
+            if (!fullmove.empty() && !parse_clock(fullmove, state.fullmove_number)) return fen_error::clocks;
+            if (!next_field(fen, index).empty()) return fen_error::trailing_text;
+        }
+
+        for (int piece = P; piece <= K; piece++) state.occupancies[white] |= state.bitboards[piece];
+        for (int piece = p; piece <= k; piece++) state.occupancies[black] |= state.bitboards[piece];
+        state.occupancies[both] = state.occupancies[white] | state.occupancies[black];
+
+        // the king of the side that just moved can not be in check, the search would capture it
+        board_state moved = state;
+        moved.side = state.side == white ? black : white;
+        if (move_generator::is_square_attacked(least_significant_bit_index(state.bitboards[moved.side == white ? K : k]), moved)) return fen_error::king_capturable;
+
+        state.zobrist_hash = get_zobrist_hash(state);
+        return fen_error::none;
+    }
+
+    board_state parse_fen(string_view fen)
+    {
+        board_state state;
+        fen_error error = parse_fen(fen, state);
+        if (error != fen_error::none) throw std::invalid_argument(string(fen_error_text(error)) + ": " + string(fen));
+        return state;
+    }
+
+    size_t parse_fen_lines(string_view text, size_t &position, std::span<board_state> boards, std::span<fen_error> errors)
+    {
+        size_t n_boards = std::min(boards.size(), errors.size());
+        size_t filled = 0;
+        while (filled < n_boards && position < text.size())
+        {
+            size_t line_end = text.find('\n', position);
+            if (line_end == string_view::npos) line_end = text.size();
+            string_view line = text.substr(position, line_end - position);
+            position = std::min(line_end + 1, text.size());
+
+            size_t index = 0;
+            if (next_field(line, index).empty()) continue;
+            errors[filled] = parse_fen(line, boards[filled]);
+            filled++;
+        }
+        return filled;
+    }
+
+    size_t to_fen(const board_state &board, char *buffer)
+    {
+        char squares[64];
+        std::fill(squares, squares + 64, 0);
+        for (int piece = P; piece <= k; piece++)
         {
-            switch (fen[fen_index])
+            U64 bitboard = board.bitboards[piece];
+            while (bitboard)
             {
-                case 'K': state.castle |= wk; break;
-                case 'Q': state.castle |= wq; break;
-                case 'k': state.castle |= bk; break;
-                case 'q': state.castle |= bq; break;
-                case '-': break;
+                squares[least_significant_bit_index(bitboard)] = piece_to_string[piece];
+                bitboard &= bitboard - 1;
             }
-            fen_index++;
         }
-        fen_index++;
 
-        // update the en passant square
-        if (fen[fen_index] != '-')
+        char *end = buffer;
+        for (int rank = 0; rank < 8; rank++)
         {
-            int file = fen[fen_index] - 'a';
-            int rank = 8 - (fen[fen_index + 1] - '0');
+            int empty = 0;
+            for (int square = rank * 8; square < rank * 8 + 8; square++)
+            {
+                if (squares[square] == 0) empty++;
+                else
+                {
+                    if (empty > 0) *end++ = '0' + empty;
+                    empty = 0;
+                    *end++ = squares[square];
+                }
+            }
+            if (empty > 0) *end++ = '0' + empty;
+            if (rank < 7) *end++ = '/';
+        }
 
-            state.enpassant = rank * 8 + file;
-        }        
+        *end++ = ' ';
+        *end++ = board.side == white ? 'w' : 'b';
+        *end++ = ' ';
+        if (board.castle == 0) *end++ = '-';
+        if (board.castle & wk) *end++ = 'K';
+        if (board.castle & wq) *end++ = 'Q';
+        if (board.castle & bk) *end++ = 'k';
+        if (board.castle & bq) *end++ = 'q';
+        *end++ = ' ';
+        if (board.enpassant == no_square) *end++ = '-';
         else
-            state.enpassant = no_square;
+        {
+            *end++ = 'a' + board.enpassant % 8;
+            *end++ = '8' - board.enpassant / 8;
+        }
+        *end++ = ' ';
+        end = std::to_chars(end, buffer + max_fen_length, board.halfmove_clock).ptr;
+        *end++ = ' ';
+        end = std::to_chars(end, buffer + max_fen_length, board.fullmove_number).ptr;
+        return end - buffer;
+    }
 
-        // update occupancies
-        for (int piece = P; piece <= K; piece++)
-            state.occupancies[white] |= state.bitboards[piece];
-        
-        for (int piece = p; piece <= k; piece++)
-            state.occupancies[black] |= state.bitboards[piece];
-        state.occupancies[both] |= state.occupancies[white];
-        state.occupancies[both] |= state.occupancies[black];
+    string to_fen(const board_state &board)
+    {
+        char buffer[max_fen_length];
+        return string(buffer, to_fen(board, buffer));
+    }
 
-        // TODO: update the halfmove clock
-        // TODO: update the fullmove counter
+    // the rook squares of the castling rights, in the order of their bits
+    const int castling_rooks[4] = {a8, h8, a1, h1};
+    const int packed_pawn_double_push = 12, packed_castling_rook = 13, packed_black_king_to_move = 15;
 
-        // recalculate the zobrist hash
-        state.zobrist_hash = get_zobrist_hash(state);
-        return state;
+    board::packed_board pack_board(const board_state &board)
+    {
+        board::packed_board packed = {};
+        packed.occupancy = board.occupancies[both];
+        for (int piece = P; piece <= k; piece++)
+        {
+            U64 bitboard = board.bitboards[piece];
+            while (bitboard)
+            {
+                int square = least_significant_bit_index(bitboard);
+                bitboard &= bitboard - 1;
+                int index = count_bits(packed.occupancy & ((1ULL << square) - 1));
+                int code = piece;
+                if (piece == k && board.side == black) code = packed_black_king_to_move;
+                packed.pieces[index / 2] |= code << (index % 2 * 4);
+            }
+        }
+
+        // the special codes replace the plain ones, which are known to be set
+        auto mark = [&](int square, int code) {
+            int index = count_bits(packed.occupancy & ((1ULL << square) - 1));
+            packed.pieces[index / 2] = (packed.pieces[index / 2] & (0xf0 >> (index % 2 * 4))) | (code << (index % 2 * 4));
+        };
+        for (int right = 0; right < 4; right++)
+        {
+            int rook = right < 2 ? r : R;
+            if ((board.castle & (1 << right)) && get_bit(board.bitboards[rook], castling_rooks[right])) mark(castling_rooks[right], packed_castling_rook);
+        }
+        if (board.enpassant != no_square)
+        {
+            int pawn_square = board.side == white ? board.enpassant + 8 : board.enpassant - 8;
+            if (get_bit(board.bitboards[board.side == white ? p : P], pawn_square)) mark(pawn_square, packed_pawn_double_push);
+        }
+        return packed;
+    }
+
+    board_state unpack_board(const board::packed_board &packed, int halfmove_clock, int fullmove_number)
+    {
+        board_state board = {};
+        board.enpassant = no_square;
+        U64 occupied = packed.occupancy;
+        for (int index = 0; occupied; index++)
+        {
+            int square = least_significant_bit_index(occupied);
+            occupied &= occupied - 1;
+            int piece = (packed.pieces[index / 2] >> (index % 2 * 4)) & 0xf;
+            if (piece >= packed_pawn_double_push)
+            {
+                if (piece == packed_black_king_to_move)
+                {
+                    piece = k;
+                    board.side = black;
+                }
+                else if (piece == packed_castling_rook)
+                {
+                    piece = square >= a1 ? R : r;
+                    for (int right = 0; right < 4; right++) if (castling_rooks[right] == square) board.castle |= 1 << right;
+                }
+                else
+                {
+                    // a white pawn on the fourth rank or a black pawn on the fifth
+                    piece = square >= a4 ? P : p;
+                    board.enpassant = piece == P ? square + 8 : square - 8;
+                }
+            }
+            board.bitboards[piece] |= 1ULL << square;
+            board.occupancies[piece <= K ? white : black] |= 1ULL << square;
+            board.zobrist_hash ^= zobrist_pieces[piece][square];
+        }
+        board.occupancies[both] = packed.occupancy;
+        board.zobrist_hash ^= zobrist_castle[board.castle];
+        if (board.side == black) board.zobrist_hash ^= zobrist_side;
+        if (board.enpassant != no_square) board.zobrist_hash ^= zobrist_enpassant[board.enpassant];
+        board.halfmove_clock = halfmove_clock;
+        board.fullmove_number = fullmove_number;
+        return board;
     }
 
     U64 get_zobrist_hash(board_state &board)
@@ -357,9 +610,9 @@ namespace board_utils
             U64 bitboard = board.bitboards[piece];
             while (bitboard)
             {
-                int square = least_significant_bit_index(bitboard);
+                int square = std::countr_zero(bitboard);
                 zobrist_hash ^= zobrist_pieces[piece][square];
-                pop_bit(bitboard, square);
+                bitboard &= bitboard - 1;
             }
         }
         zobrist_hash ^= zobrist_castle[board.castle];
@@ -393,6 +646,8 @@ namespace board_utils
         cout << "    Side:          " << (state.side ? "black" : "white") << endl;
         cout << "    Enpassant:     " << (state.enpassant != no_square ? square_to_coordinates[state.enpassant] : "-") << endl;
         cout << "    Castling:      " << ((state.castle & wk) ? 'K' : '-') << ((state.castle & wq) ? 'Q' : '-') << ((state.castle & bk) ? 'k' : '-') << ((state.castle & bq) ? 'q' : '-') << endl;
+        cout << "    Halfmove:      " << state.halfmove_clock << endl;
+        cout << "    Fullmove:      " << state.fullmove_number << endl;
         cout << "    Hash key:      " << state.zobrist_hash << endl << endl << endl;
     }
 
@@ -1,101 +1,331 @@
 #include "Engine/engine.h"
 #include "Engine/transpositionTable.h"
+#include "Engine/repetition.h"
 #include "MoveGenerator/MoveGenerator.h"
 #include "Board/board.h"
 #include "utils.h"
+#include "simd.h"
 
 #include <iostream>
 #include <array>
 #include <vector>
 #include <span>
 #include <chrono>
+#include <algorithm>
+#include <thread>
 
-using move_generator::generate_moves, move_generator::is_square_attacked, move_generator::print_move_list;
+using move_generator::generate_moves, move_generator::is_square_attacked, move_generator::print_move_list, move_generator::see;
+using move_generator::check_info, move_generator::find_check_info, move_generator::gives_check;
+using move_generator::find_attack_info, move_generator::in_check;
 using board::make_move, board::move_to_string, board::move_capture;
 using board::move_piece, board::move_promotion, board::move_target;
 using board::is_promoting;
 using namespace constants;
 using namespace bitboard_utils;
-using transposition_table::add_move_to_table, transposition_table::get_evaluation_from_table;
+using repetition::is_repetition, repetition::has_upcoming_repetition;
+using zobrist::zobrist_side, zobrist::zobrist_enpassant;
 using transposition_table::exact, transposition_table::lowerbound, transposition_table::upperbound;
 
 using std::cout, std::endl;
 using std::array, std::vector, std::span;
 
 
-int Engine::nodes_searched() { return nodes; }
-unsigned int Engine::best_move() { return pv_table[0][0]; }
-bool Engine::time_up() { return (std::chrono::steady_clock::now() - search_start_time) > time_limit; }
+Engine::Engine() : table(std::make_shared<TranspositionTable>()) {}
+Engine::Engine(std::shared_ptr<TranspositionTable> shared_table) : table(shared_table) {}
+Engine::~Engine() { abandon_search(); }
+void Engine::set_transposition_table(std::shared_ptr<TranspositionTable> shared_table)
+{
+    table = shared_table;
+    for (std::unique_ptr<Engine> &helper : helpers) helper->set_transposition_table(shared_table);
+}
+std::shared_ptr<TranspositionTable> Engine::get_transposition_table() { return table; }
+U64 Engine::nodes_searched()
+{
+    U64 total = nodes.load(std::memory_order_relaxed);
+    for (std::unique_ptr<Engine> &helper : helpers) total += helper->nodes.load(std::memory_order_relaxed);
+    return total;
+}
+void Engine::set_info_callback(info_callback callback) { report_info = callback; }
+void Engine::set_evaluation_parameters(const evaluation_parameters &new_parameters)
+{
+    parameters = new_parameters;
+    for (std::unique_ptr<Engine> &helper : helpers) helper->parameters = new_parameters;
+}
+int Engine::static_evaluation(board_state &board)
+{
+    attack_info attack_map = find_attack_info(board);
+    return evaluate(board, attack_map);
+}
+void Engine::count_node(int depth_from_root)
+{
+    // plain load and store instead of an increment, since no other thread writes the counter
+    nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    selective_depth = std::max(selective_depth, depth_from_root);
+}
+unsigned int Engine::best_move() { return principal_variations.empty() ? pv_table[0][0] : principal_variations[0].moves[0]; }
+unsigned int Engine::ponder_move(board_state &board)
+{
+    // the expected reply is the second move of the best line, or the hash move after the best move if the line was cut short
+    if (!principal_variations.empty() && principal_variations[0].moves.size() > 1) return principal_variations[0].moves[1];
+
+    unsigned int move = best_move();
+    if (move == 0) return 0;
+    board_state next_board = make_move(board, move);
+    unsigned int reply = table->get_move_from_table(next_board.zobrist_hash);
+    array<unsigned int, max_moves> move_list;
+    span<unsigned int> moves = generate_moves(next_board, move_list, false);
+    return std::ranges::find(moves, reply) != moves.end() ? reply : 0;
+}
+void Engine::set_multi_pv(int lines) { multi_pv = std::clamp(lines, 1, max_moves); }
+void Engine::set_threads(int threads)
+{
+    n_threads = std::max(threads, 1);
+    helpers.clear();
+    for (int i = 1; i < n_threads; i++)
+    {
+        helpers.push_back(std::make_unique<Engine>(table));
+        helpers.back()->thread_index = i;
+        helpers.back()->parameters = parameters;
+    }
+}
+const vector<principal_variation>& Engine::get_principal_variations() { return principal_variations; }
+void Engine::stop() { stop_search.store(true, std::memory_order_relaxed); }
+void Engine::ponder_hit() { timer.ponder_hit(); }
+bool Engine::should_stop() { return stop_search.load(std::memory_order_relaxed); }
+void Engine::clear_history() { game_length = 0; }
+void Engine::clear_move_ordering()
+{
+    killer_moves = {};
+    history_moves = {};
+    pv_table = {};  // the moves past the end of the last line are still tried first
+    pv_length = {};
+    for (std::unique_ptr<Engine> &helper : helpers) helper->clear_move_ordering();
+}
+void Engine::add_to_history(U64 zobrist_hash)
+{
+    // only the recent positions can repeat, so drop the oldest half when the history is full
+    if (game_length == max_game_ply)
+    {
+        std::copy(hash_history.begin() + max_game_ply / 2, hash_history.begin() + max_game_ply, hash_history.begin());
+        game_length -= max_game_ply / 2;
+    }
+    hash_history[game_length++] = zobrist_hash;
+}
+void Engine::check_time()
+{
+    // reading the clock is expensive (performance.now() in the browser), so only do it every few thousand nodes
+    if ((nodes.load(std::memory_order_relaxed) & (time_check_interval - 1)) != 0) return;
+    if (timer.hard_limit_reached() || (node_limit != 0 && nodes_searched() >= node_limit)) stop();
+    else if (in_slice && slice_node_end != 0 && nodes.load(std::memory_order_relaxed) >= slice_node_end) search_fiber.yield();
+    else if (in_slice && slice_node_end == 0 && std::chrono::steady_clock::now() >= slice_end) search_fiber.yield();
+}
+void Engine::abandon_search()
+{
+    // the stopped search returns through every frame of its fiber, outside of a slice it does not yield
+    if (!search_fiber.running()) return;
+    sliced_search_abandoned = true;
+    stop();
+    while (search_fiber.running()) search_fiber.resume();
+}
+void Engine::start_search(board_state &board, search_limits limits)
+{
+    abandon_search();  // a search whose result was never collected
+    sliced_board = board;
+    sliced_limits = limits;
+    sliced_evaluation = invalid_evaluation;
+    sliced_search_abandoned = false;
+    nodes.store(0, std::memory_order_relaxed);  // the node budget of the first slice is counted from here
+    search_fiber.start(run_sliced_search, this);
+}
+bool Engine::search_step(int budget_milli_seconds)
+{
+    slice_end = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_milli_seconds);
+    slice_node_end = 0;
+    return resume_search();
+}
+bool Engine::search_step_nodes(U64 node_budget)
+{
+    slice_node_end = nodes.load(std::memory_order_relaxed) + std::max<U64>(node_budget, 1);
+    return resume_search();
+}
+bool Engine::resume_search()
+{
+    in_slice = true;
+    search_fiber.resume();
+    in_slice = false;
+    return !search_fiber.running();
+}
+int Engine::search_result() { return sliced_evaluation; }
+void Engine::run_sliced_search(void *engine)
+{
+    Engine *self = static_cast<Engine *>(engine);
+    if (self->sliced_search_abandoned) return;  // abandoned before the first slice
+    self->sliced_evaluation = self->iterative_search(self->sliced_board, self->sliced_limits);
+}
 int Engine::iterative_search(board_state &board, int time_milli_seconds)
 {
-    time_limit = std::chrono::milliseconds{time_milli_seconds};
-    int depth = 10000;
-    search_start_time = std::chrono::steady_clock::now();
-    bool in_check = is_square_attacked(board.side == white ? least_significant_bit_index(board.bitboards[K]) : least_significant_bit_index(board.bitboards[k]), board);
-
-    int evaluation;
-    int middle = 0;
-    int lower_window = alpha_beta_bounds_start;
-    int upper_window = alpha_beta_bounds_start;
-    int alpha;
-    int beta;
-    for (int iterative_depth = 1; iterative_depth <= depth; iterative_depth++)
+    search_limits limits;
+    limits.move_time = time_milli_seconds;
+    return iterative_search(board, limits);
+}
+int Engine::iterative_search(board_state &board, search_limits limits)
+{
+    int depth = limits.depth > 0 ? std::min(limits.depth, max_search_depth) : max_search_depth;
+    timer.start(limits);
+    node_limit = limits.nodes > 0 ? limits.nodes : 0;
+    if (thread_index == 0) stop_search.store(false, std::memory_order_relaxed);
+
+    // a mate or stalemate at the root has no move to search, and the results of the previous search must not be reported
+    attack_info root_attack_map = find_attack_info(board);
+    bool root_in_check = in_check(board, root_attack_map);
+    principal_variations.clear();
+    pv_table[0][0] = 0;
+    pv_length[0] = 0;
+    nodes.store(0, std::memory_order_relaxed);
+    array<unsigned int, max_moves> root_moves;
+    if (generate_moves(board, root_moves, false).empty())
     {
-        nodes = 0;
-        while (true)
+        int evaluation = root_in_check ? -check_mate_score : 0;
+        if (thread_index == 0 && report_info)
         {
-            alpha = middle - lower_window;
-            beta = middle + upper_window;
-            evaluation = negamax(board, alpha, beta, iterative_depth, 0, 0, in_check, false);
-            if (time_up()) break;
+            search_info info = {};
+            info.multi_pv = 1;
+            info.evaluation = evaluation;
+            info.hashfull = table->hashfull();
+            report_info(info);
+        }
+        return evaluation;
+    }
 
-            if (evaluation >= beta)
-            {
-                cout << "Aspiration window failed high!" << endl;
-                upper_window *= 3;
-                continue;
-            }
-            if (evaluation <= alpha)
+    // the helpers search without limits until the main thread stops them
+    vector<std::thread> helper_threads;
+    for (std::unique_ptr<Engine> &helper : helpers)
+    {
+        Engine *helper_engine = helper.get();
+        std::copy(hash_history.begin(), hash_history.begin() + game_length, helper_engine->hash_history.begin());
+        helper_engine->game_length = game_length;
+        helper_engine->stop_search.store(false, std::memory_order_relaxed);
+        search_limits helper_limits;
+        helper_limits.depth = limits.depth;
+        helper_threads.emplace_back([helper_engine, board, helper_limits]() mutable { helper_engine->iterative_search(board, helper_limits); });
+    }
+
+    int best_evaluation = invalid_evaluation;
+    // every other helper skips the first iteration, so that the threads are spread over different depths
+    for (int iterative_depth = 1 + thread_index % 2; iterative_depth <= depth; iterative_depth++)
+    {
+        selective_depth = 0;
+
+        // search the root once for every line, excluding the best moves of the earlier lines
+        n_excluded_root_moves = 0;
+        for (int line = 0; line < multi_pv; line++)
+        {
+            // start from the principal variation of this line in the previous iteration
+            int previous_evaluation = invalid_evaluation;
+            pv_length[0] = 0;
+            if ((size_t)line < principal_variations.size())
             {
-                cout << "Aspiration window failed low!" << endl;
-                lower_window *= 3;
-                continue;
+                principal_variation &previous = principal_variations[line];
+                previous_evaluation = previous.evaluation;
+                pv_length[0] = previous.moves.size();
+                std::copy(previous.moves.begin(), previous.moves.end(), pv_table[0].begin());
             }
 
-            cout << "Depth: " << iterative_depth;
-            cout << " Evaluation: " << evaluation << " cp";
-            cout << " Nodes: " << nodes_searched();
-            cout << " Time: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - search_start_time);
-            cout << " Principal variation: ";
-            print_principal_variation();
-
-            lower_window = material_score[P] / 2;
-            upper_window = material_score[P] / 2;
-            middle = evaluation;
-            break;
+            int evaluation = aspiration_search(board, iterative_depth, root_in_check, previous_evaluation);
+            if (should_stop()) break;
+            if (pv_length[0] == 0) break;  // fewer legal moves than lines
+
+            principal_variation current = {evaluation, iterative_depth, vector<unsigned int>(pv_table[0].begin(), pv_table[0].begin() + pv_length[0])};
+            if ((size_t)line < principal_variations.size()) principal_variations[line] = current;
+            else principal_variations.push_back(current);
+            excluded_root_moves[n_excluded_root_moves++] = current.moves[0];
+
+            if (thread_index != 0 || !report_info) continue;
+            search_info info;
+            info.depth = iterative_depth;
+            info.selective_depth = selective_depth;
+            info.multi_pv = line + 1;
+            info.evaluation = evaluation;
+            info.nodes = nodes_searched();
+            info.time = timer.elapsed_milli_seconds();
+            info.nodes_per_second = info.nodes * 1000 / std::max(info.time, 1);
+            info.hashfull = table->hashfull();
+            info.principal_variation = current.moves;
+            report_info(info);
         }
+        n_excluded_root_moves = 0;
+
+        // lines found later may have improved on the earlier ones
+        std::stable_sort(principal_variations.begin(), principal_variations.end(), [](const principal_variation &a, const principal_variation &b) { return a.evaluation > b.evaluation; });
+        if (!principal_variations.empty()) best_evaluation = principal_variations[0].evaluation;
 
-        if (time_up()) break;
+        if (should_stop()) break;
 
+        // do not start an iteration, which is unlikely to finish in time
+        timer.update(iterative_depth, best_move(), best_evaluation);
+        if (timer.soft_limit_reached()) break;
     }
-    return evaluation;
+
+    for (std::unique_ptr<Engine> &helper : helpers) helper->stop();
+    for (std::thread &helper_thread : helper_threads) helper_thread.join();
+    return best_evaluation;
 }
-void Engine::print_principal_variation()
+int Engine::aspiration_search(board_state &board, int depth, bool in_check, int previous_evaluation)
 {
-    for (int i = 0; i < pv_length[0]; i++)
+    // search a narrow window around the previous evaluation, widening it on failure
+    int middle = previous_evaluation == invalid_evaluation ? 0 : previous_evaluation;
+    int lower_window = previous_evaluation == invalid_evaluation ? alpha_beta_bounds_start : parameters.material[P] / 2;
+    int upper_window = lower_window;
+    while (true)
     {
-        cout << move_to_string(pv_table[0][i]) << " ";
+        int alpha = std::max(middle - lower_window, -alpha_beta_bounds_start);
+        int beta = std::min(middle + upper_window, alpha_beta_bounds_start);
+        int evaluation = negamax(board, alpha, beta, depth, 0, 0, in_check, false);
+        if (should_stop()) return invalid_evaluation;
+
+        if (evaluation >= beta && beta < alpha_beta_bounds_start)
+        {
+#ifdef SEARCH_LOGGING
+            cout << "Aspiration window failed high!" << endl;
+#endif
+            upper_window *= 3;
+            continue;
+        }
+        if (evaluation <= alpha && alpha > -alpha_beta_bounds_start)
+        {
+#ifdef SEARCH_LOGGING
+            cout << "Aspiration window failed low!" << endl;
+#endif
+            lower_window *= 3;
+            continue;
+        }
+        return evaluation;
     }
-    cout << endl;
 }
 
 int Engine::negamax(board_state &board, int alpha, int beta, int depth, int depth_from_root, int total_extension, bool in_check, bool allow_pruning)
 {
-    if (time_up()) return invalid_evaluation;
-    nodes++;
+    if (should_stop()) return invalid_evaluation;
+    count_node(depth_from_root);
+    check_time();
     pv_length[depth_from_root] = depth_from_root;
 
-    int table_evaluation = get_evaluation_from_table(board.zobrist_hash, depth, alpha, beta);
+    hash_history[game_length + depth_from_root] = board.zobrist_hash;
+    if (depth_from_root > 0)
+    {
+        span<const U64> history(hash_history.begin(), game_length + depth_from_root + 1);
+        if (board.halfmove_clock >= 100 || is_repetition(board, history, depth_from_root)) return 0;
+
+        // a draw can be forced if some move repeats an earlier position
+        if (alpha < 0 && has_upcoming_repetition(board, history, depth_from_root))
+        {
+            alpha = 0;
+            if (alpha >= beta) return alpha;
+        }
+    }
+
+    // the root is always searched to get the best move and the excluded moves of the other lines into account
+    int table_evaluation = depth_from_root > 0 ? table->get_evaluation_from_table(board.zobrist_hash, depth, alpha, beta) : invalid_evaluation;
     if (table_evaluation != invalid_evaluation)
     {
         return table_evaluation;
@@ -103,11 +333,13 @@ int Engine::negamax(board_state &board, int alpha, int beta, int depth, int dept
 
     if (depth <= 0)
     {
-        int evaluation = quiescence_search(board, alpha, beta);
+        int evaluation = quiescence_search(board, alpha, beta, depth_from_root);
         return evaluation;
     }
 
-    int static_eval = evaluate(board);
+    // attacks of both sides are shared by the evaluation and the move generation
+    attack_info attack_map = find_attack_info(board);
+    int static_eval = evaluate(board, attack_map);
 
     // null move pruning
     bool not_pv = alpha == beta - 1;
@@ -125,16 +357,24 @@ int Engine::negamax(board_state &board, int alpha, int beta, int depth, int dept
         }
         if (pieces_remaining > 2)
         {
+            // the null move is irreversible, so repetitions are not searched across it
             int en_passant_square = board.enpassant;
+            int halfmove_clock = board.halfmove_clock;
+            U64 zobrist_hash = board.zobrist_hash;
+            if (en_passant_square != no_square) board.zobrist_hash ^= zobrist_enpassant[en_passant_square];
+            board.zobrist_hash ^= zobrist_side;
             board.enpassant = no_square;
+            board.halfmove_clock = 0;
             board.side ^= 1;
 
             int evaluation = -negamax(board, -beta, -beta + 1, depth - 3, depth_from_root + 1, total_extension, false, false);
 
             board.enpassant = en_passant_square;
+            board.halfmove_clock = halfmove_clock;
+            board.zobrist_hash = zobrist_hash;
             board.side ^= 1;
 
-            if (time_up()) return invalid_evaluation;
+            if (should_stop()) return invalid_evaluation;
             if (evaluation >= beta) return beta;
         }
     }
@@ -142,14 +382,22 @@ int Engine::negamax(board_state &board, int alpha, int beta, int depth, int dept
     bool found_pv_node = false;
     int node_type = upperbound;
     array<unsigned int, max_moves> move_list;
-    span<unsigned int> moves = generate_moves(board, move_list, false);
-    sort_moves(moves, !not_pv, depth_from_root);
+    span<unsigned int> moves = generate_moves(board, move_list, false, attack_map);
+    sort_moves(board, moves, !not_pv, depth_from_root);
+    check_info info = find_check_info(board);
     for (int i = 0; i < moves.size(); i++)
     {
         unsigned int move = moves[i];
-        board_state next_state = make_move(board, move);
+        if (depth_from_root == 0 && std::find(excluded_root_moves.begin(), excluded_root_moves.begin() + n_excluded_root_moves, move) != excluded_root_moves.begin() + n_excluded_root_moves)
+            continue;
+        bool move_in_check = gives_check(board, info, move);
 
-        bool move_in_check = is_square_attacked(next_state.side == white ? least_significant_bit_index(next_state.bitboards[K]) : least_significant_bit_index(next_state.bitboards[k]), next_state);
+        // skip quiet moves, which lose material at shallow depths
+        bool quiet = move_capture(move) == no_piece && move_promotion(move) == no_promotion;
+        if (not_pv && !in_check && !move_in_check && quiet && i > 0 && depth <= see_pruning_depth && !see(board, move, -see_quiet_margin * depth))
+            continue;
+
+        board_state next_state = make_move(board, move);
 
         int extension = search_extension(move, total_extension, move_in_check, moves.size());
         int move_total_extension = total_extension + extension;
@@ -161,27 +409,33 @@ int Engine::negamax(board_state &board, int alpha, int beta, int depth, int dept
         {
             int reduction = late_move_reduction(move, depth, i, extension);
             if (reduction > 0)
+            {
                 evaluation = -negamax(next_state, -alpha - 1, -alpha, depth - 1 + extension - reduction, depth_from_root + 1, move_total_extension, move_in_check, true);
-                if (time_up()) return invalid_evaluation;
+                if (should_stop()) return invalid_evaluation;
+            }
             else
                 evaluation = alpha + 1;
 
             if (evaluation > alpha)
             {
                 evaluation = -negamax(next_state, -alpha - 1, -alpha, depth - 1 + extension, depth_from_root + 1, move_total_extension, move_in_check, true);
-                if (time_up()) return invalid_evaluation;
+                if (should_stop()) return invalid_evaluation;
                 if (evaluation > alpha && evaluation < beta)
+                {
                     evaluation = -negamax(next_state, -beta, -alpha, depth - 1 + extension, depth_from_root + 1, move_total_extension, move_in_check, true);
-                    if (time_up()) return invalid_evaluation;
+                    if (should_stop()) return invalid_evaluation;
+                }
             }
         }
         else
+        {
             evaluation = -negamax(next_state, -beta, -alpha, depth - 1 + extension, depth_from_root + 1, move_total_extension, move_in_check, true);
-            if (time_up()) return invalid_evaluation;
+            if (should_stop()) return invalid_evaluation;
+        }
 
         if (evaluation >= beta)
         {
-            add_move_to_table(board.zobrist_hash, move, depth, lowerbound, evaluation);
+            table->add_move_to_table(board.zobrist_hash, move, depth, lowerbound, evaluation);
 
             // store killer moves
             killer_moves[1][depth_from_root] = killer_moves[0][depth_from_root];
@@ -220,35 +474,41 @@ int Engine::negamax(board_state &board, int alpha, int beta, int depth, int dept
     }
 
     unsigned int best_move = pv_table[depth_from_root][depth_from_root];
-    add_move_to_table(board.zobrist_hash, best_move, depth, node_type, alpha);
+    table->add_move_to_table(board.zobrist_hash, best_move, depth, node_type, alpha);
 
     return alpha;
 }
 
-int Engine::quiescence_search(board_state &board, int alpha, int beta)
+int Engine::quiescence_search(board_state &board, int alpha, int beta, int depth_from_root)
 {
-    if (time_up()) return invalid_evaluation;
-    nodes++;
-    int evaluation = evaluate(board);
+    if (should_stop()) return invalid_evaluation;
+    count_node(depth_from_root);
+    check_time();
+    attack_info attack_map = find_attack_info(board);
+    int evaluation = evaluate(board, attack_map);
     if(evaluation >= beta)
         return beta;
 
-    int margin = delta_cutoff;  // margin = queen
-    if ( is_promoting(board) ) margin += material_score[4] - material_score[0];  // margin = 2 * queen - pawn
+    int margin = parameters.material[Q];  // margin = queen
+    if ( is_promoting(board) ) margin += parameters.material[Q] - parameters.material[P];  // margin = 2 * queen - pawn
     if ( evaluation < alpha - margin ) return alpha;
     
     if(alpha < evaluation)
         alpha = evaluation;
 
     array<unsigned int, max_moves> move_list;
-    span<unsigned int> moves = generate_moves(board, move_list, true);
-    sort_moves(moves, false, -1);
+    span<unsigned int> moves = generate_moves(board, move_list, true, attack_map);
+    sort_moves(board, moves, false, -1);
     for (int i = 0; i < moves.size(); i++)
     {
         unsigned int move = moves[i];
+
+        // captures losing material can not raise alpha
+        if (!see(board, move, 0)) continue;
+
         board_state next_state = make_move(board, move);
-        int evaluation = -quiescence_search(next_state, -beta, -alpha);
-        if (time_up()) return invalid_evaluation;
+        int evaluation = -quiescence_search(next_state, -beta, -alpha, depth_from_root + 1);
+        if (should_stop()) return invalid_evaluation;
 
         if (evaluation >= beta)
         {
@@ -262,7 +522,7 @@ int Engine::quiescence_search(board_state &board, int alpha, int beta)
     return alpha;
 }
 
-int Engine::evaluate(board_state &board)
+int Engine::evaluate(board_state &board, attack_info &attack_map)
 {
     int evaluation = 0;
     for (int piece = P; piece <= k; piece++)
@@ -271,24 +531,35 @@ int Engine::evaluate(board_state &board)
         while (bitboard)
         {
             int square = least_significant_bit_index(bitboard);
-            evaluation += material_score[piece];
-
             if (piece <= K)
             {
-                evaluation += mg_table[piece][square];
+                evaluation += parameters.material[piece] + parameters.piece_square[piece][square];
             }
             else
             {
-                evaluation -= mg_table[piece - 6][mirror_score[square]];
+                evaluation -= parameters.material[piece - 6] + parameters.piece_square[piece - 6][mirror_score[square]];
             }
 
             pop_bit(bitboard, square);
         }
     }
+
+    if (!parameters.uses_attack_terms()) return board.side == white ? evaluation : -evaluation;
+
+    // mobility and pressure on the enemy king from the attack maps, white in the low lane and black in the high lane
+    simd::u64x2 own_pieces = simd::load(board.occupancies);
+    for (int piece = N; piece <= Q; piece++)
+    {
+        simd::u64x2 mobility = simd::count_bits(simd::and_not(simd::make(attack_map.attacks_by_piece[piece], attack_map.attacks_by_piece[piece + 6]), own_pieces));
+        evaluation += parameters.mobility[piece] * ((int)simd::low(mobility) - (int)simd::high(mobility));
+    }
+    simd::u64x2 king_zone_attacks = simd::count_bits(simd::bit_and(simd::load(attack_map.attacked.data()), simd::make(attack_map.king_zone[black], attack_map.king_zone[white])));
+    evaluation += parameters.king_zone_attack * ((int)simd::low(king_zone_attacks) - (int)simd::high(king_zone_attacks));
+
     return board.side == white ? evaluation : -evaluation;
 }
 
-void Engine::sort_moves(span<unsigned int> moves, bool score_pv_move, int depth_from_root)
+void Engine::sort_moves(board_state &board, span<unsigned int> moves, bool score_pv_move, int depth_from_root)
 {
     vector<int> scores;
     scores.reserve(moves.size());  // reserve the correct amount of memory in advance
@@ -312,7 +583,8 @@ void Engine::sort_moves(span<unsigned int> moves, bool score_pv_move, int depth_
         int captured_piece = move_capture(move);
         if (captured_piece != no_piece)
         {
-            scores.push_back(non_quiet_bonus + mvv_lva[move_piece(move)][captured_piece] + promotion_bonus);
+            int bonus = see(board, move, 0) ? non_quiet_bonus : bad_capture_penalty;
+            scores.push_back(bonus + parameters.mvv_lva[move_piece(move) % 6][captured_piece % 6] + promotion_bonus);
             continue;
         }
         if (promoted_piece != no_promotion)
@@ -322,6 +594,11 @@ void Engine::sort_moves(span<unsigned int> moves, bool score_pv_move, int depth_
         }
 
         // score quiet moves based on history and killer moves
+        if (depth_from_root < 0)
+        {
+            scores.push_back(0);
+            continue;
+        }
         if (move == killer_moves[0][depth_from_root])
         {
             scores.push_back(first_killer_bonus);
@@ -0,0 +1,77 @@
+#include "Engine/fiber.h"
+
+#include <cstdint>
+
+
+namespace fiber
+{
+#ifndef __EMSCRIPTEN__
+    // makecontext only passes int arguments, so the pointer is split into two halves
+    void Fiber::ucontext_trampoline(unsigned int high, unsigned int low)
+    {
+        trampoline(reinterpret_cast<void *>((static_cast<uintptr_t>(high) << 16 << 16) | low));
+    }
+#endif
+
+    void Fiber::trampoline(void *fiber)
+    {
+        // the entry function of a fiber must never return, so switch back for good when the work is done
+        Fiber *self = static_cast<Fiber *>(fiber);
+        self->entry(self->argument);
+        self->finished = true;
+        self->yield();
+    }
+
+    void Fiber::set_stack_size(size_t bytes) { stack_size = bytes; }
+
+    void Fiber::start(void (*entry_function)(void *), void *entry_argument)
+    {
+        entry = entry_function;
+        argument = entry_argument;
+        started = true;
+        finished = false;
+        if (allocated_stack_size != stack_size)
+        {
+            stack.reset(new char[stack_size]);
+            allocated_stack_size = stack_size;
+        }
+
+#ifdef __EMSCRIPTEN__
+        if (asyncify_stack.empty())
+        {
+            asyncify_stack.resize(asyncify_stack_size);
+            caller_asyncify_stack.resize(asyncify_stack_size);
+        }
+        emscripten_fiber_init(&context, trampoline, this, stack.get(), stack_size, asyncify_stack.data(), asyncify_stack.size());
+#else
+        getcontext(&context);
+        context.uc_stack.ss_sp = stack.get();
+        context.uc_stack.ss_size = stack_size;
+        context.uc_link = nullptr;
+        uintptr_t pointer = reinterpret_cast<uintptr_t>(this);
+        makecontext(&context, reinterpret_cast<void (*)()>(ucontext_trampoline), 2, static_cast<unsigned int>(pointer >> 16 >> 16), static_cast<unsigned int>(pointer));
+#endif
+    }
+
+    void Fiber::resume()
+    {
+        if (!running()) return;
+#ifdef __EMSCRIPTEN__
+        emscripten_fiber_init_from_current_context(&caller_context, caller_asyncify_stack.data(), caller_asyncify_stack.size());
+        emscripten_fiber_swap(&caller_context, &context);
+#else
+        swapcontext(&caller_context, &context);
+#endif
+    }
+
+    void Fiber::yield()
+    {
+#ifdef __EMSCRIPTEN__
+        emscripten_fiber_swap(&context, &caller_context);
+#else
+        swapcontext(&context, &caller_context);
+#endif
+    }
+
+    bool Fiber::running() { return started && !finished; }
+}
@@ -0,0 +1,112 @@
+#include "Engine/repetition.h"
+#include "Engine/transpositionTable.h"
+#include "MoveGenerator/AttackTables.h"
+#include "Board/board.h"
+#include "utils.h"
+
+#include <array>
+#include <span>
+#include <algorithm>
+
+using namespace constants;
+using zobrist::zobrist_pieces, zobrist::zobrist_side;
+using piece_attacks::knight_attacks, piece_attacks::bishop_attacks, piece_attacks::rook_attacks;
+using piece_attacks::queen_attacks, piece_attacks::king_attacks, piece_attacks::between_mask;
+using board::move_source, board::move_target;
+
+using std::array;
+using std::span;
+using std::min, std::swap;
+
+
+namespace repetition
+{
+    array<U64, cuckoo_size> cuckoo_keys;
+    array<unsigned int, cuckoo_size> cuckoo_moves;
+
+    int cuckoo_index_1(U64 key) { return key & (cuckoo_size - 1); }
+    int cuckoo_index_2(U64 key) { return (key >> 16) & (cuckoo_size - 1); }
+
+    void init_cuckoo_tables()
+    {
+        cuckoo_keys.fill(0ULL);
+        cuckoo_moves.fill(0);
+        for (int piece = N; piece <= k; piece++)
+        {
+            if (piece == p) continue;  // pawn moves are never reversible
+            for (int source = 0; source < 64; source++)
+            {
+                for (int target = source + 1; target < 64; target++)
+                {
+                    U64 attacks_board;
+                    switch (piece % 6)
+                    {
+                        case N: attacks_board = knight_attacks(source); break;
+                        case B: attacks_board = bishop_attacks(source, 0ULL); break;
+                        case R: attacks_board = rook_attacks(source, 0ULL); break;
+                        case Q: attacks_board = queen_attacks(source, 0ULL); break;
+                        default: attacks_board = king_attacks(source); break;
+                    }
+                    if (!(attacks_board & (1ULL << target))) continue;
+
+                    // insert the move, displacing earlier entries to their alternative slot
+                    U64 key = zobrist_pieces[piece][source] ^ zobrist_pieces[piece][target] ^ zobrist_side;
+                    unsigned int move = board::encode_move(source, target, piece, no_promotion, no_piece, 0, 0, 0);
+                    int index = cuckoo_index_1(key);
+                    while (true)
+                    {
+                        swap(cuckoo_keys[index], key);
+                        swap(cuckoo_moves[index], move);
+                        if (move == 0) break;
+                        index = index == cuckoo_index_1(key) ? cuckoo_index_2(key) : cuckoo_index_1(key);
+                    }
+                }
+            }
+        }
+    }
+
+    bool is_repetition(board_state &board, span<const U64> history, int depth_from_root)
+    {
+        // only positions since the last capture or pawn move can repeat
+        int current = history.size() - 1;
+        int end = min(board.halfmove_clock, current);
+        int count = 0;
+        for (int i = 4; i <= end; i += 2)
+        {
+            if (history[current - i] != board.zobrist_hash) continue;
+            if (i <= depth_from_root) return true;  // repeated inside the search tree
+            if (++count == 2) return true;  // threefold repetition with the game history
+        }
+        return false;
+    }
+
+    bool has_upcoming_repetition(board_state &board, span<const U64> history, int depth_from_root)
+    {
+        int current = history.size() - 1;
+        int end = min(board.halfmove_clock, current);
+        if (end < 3) return false;
+
+        // other is zero when the opponent's moves since the earlier position cancel out
+        U64 original_key = history[current];
+        U64 other = original_key ^ history[current - 1] ^ zobrist_side;
+        for (int i = 3; i <= end; i += 2)
+        {
+            other ^= history[current - i + 1] ^ history[current - i] ^ zobrist_side;
+            if (other != 0) continue;
+
+            U64 move_key = original_key ^ history[current - i];
+            int index = cuckoo_index_1(move_key);
+            if (cuckoo_keys[index] != move_key)
+            {
+                index = cuckoo_index_2(move_key);
+                if (cuckoo_keys[index] != move_key) continue;
+            }
+
+            // the move repeats the position if nothing stands in between and the cycle is inside the search tree
+            unsigned int move = cuckoo_moves[index];
+            if ((between_mask[move_source(move)][move_target(move)] & board.occupancies[both]) == 0 && depth_from_root > i)
+                return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,209 @@
+#include "Engine/searchScheduler.h"
+#include "engineContext.h"
+#include "Engine/engine.h"
+
+#include <algorithm>
+#include <chrono>
+
+using std::unique_lock;
+using std::lock_guard;
+
+
+namespace search_scheduler
+{
+    int milli_seconds_between(std::chrono::time_point<std::chrono::steady_clock> start, std::chrono::time_point<std::chrono::steady_clock> end)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+    }
+
+    SearchScheduler::SearchScheduler(int n_workers, std::shared_ptr<TranspositionTable> shared_table, U64 nodes_per_slice)
+        : table(shared_table ? shared_table : std::make_shared<TranspositionTable>()), slice_nodes(nodes_per_slice)
+    {
+        for (int i = 0; i < std::max(n_workers, 1); i++) workers.emplace_back(&SearchScheduler::worker_loop, this);
+    }
+
+    SearchScheduler::~SearchScheduler() { shutdown(); }
+
+    void SearchScheduler::shutdown()
+    {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            shutting_down = true;
+        }
+        work_available.notify_all();
+        for (std::thread &worker : workers) worker.join();
+        workers.clear();
+
+        // the workers put back the searches they were running, so every unfinished search is here.
+        // they are answered as stopped, so that no client waits for a result forever
+        vector<std::unique_ptr<scheduled_search>> unfinished;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            unfinished.swap(runnable);
+        }
+        for (std::unique_ptr<scheduled_search> &search : unfinished)
+        {
+            search_outcome outcome = outcome_of(*search, true);
+            search->context->engine().abandon_search();  // after the moves are read, the unwinding search does not report
+            if (search->task.on_finished) search->task.on_finished(outcome);
+        }
+    }
+
+    search_outcome SearchScheduler::outcome_of(scheduled_search &search, bool stopped)
+    {
+        // a context is reused, so its engine only has results once this search has started
+        Engine &engine = search.context->engine();
+        search_outcome outcome;
+        outcome.id = search.id;
+        outcome.best_move = search.started ? engine.best_move() : 0;
+        outcome.ponder_move = search.started ? engine.ponder_move(search.context->position()) : 0;
+        outcome.evaluation = search.started ? engine.search_result() : 0;
+        outcome.nodes = search.started ? engine.nodes_searched() : 0;
+        outcome.slices = search.slices;
+        outcome.queue_milli_seconds = search.queue_milli_seconds;
+        outcome.total_milli_seconds = milli_seconds_between(search.submitted, std::chrono::steady_clock::now());
+        outcome.stopped = stopped;
+        engine.set_info_callback(nullptr);
+        return outcome;
+    }
+
+    std::unique_ptr<EngineContext> SearchScheduler::take_context()
+    {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (!spare_contexts.empty())
+            {
+                std::unique_ptr<EngineContext> context = std::move(spare_contexts.back());
+                spare_contexts.pop_back();
+                return context;
+            }
+        }
+        return std::make_unique<EngineContext>(table);
+    }
+
+    int SearchScheduler::submit(search_task task)
+    {
+        std::unique_ptr<scheduled_search> search = std::make_unique<scheduled_search>();
+        search->submitted = std::chrono::steady_clock::now();
+        search->context = take_context();
+
+        bool valid = search->context->set_position(task.fen);
+        for (const string &move : task.moves) valid = valid && search->context->play_move(move);
+        if (!valid)
+        {
+            lock_guard<std::mutex> lock(mutex);
+            spare_contexts.push_back(std::move(search->context));
+            return -1;
+        }
+
+        Engine &engine = search->context->engine();
+        engine.set_multi_pv(task.multi_pv);
+        engine.set_info_callback(task.on_info);
+        if (task.limits.move_time >= 0)
+        {
+            search->has_deadline = true;
+            search->deadline = search->submitted + std::chrono::milliseconds(task.limits.move_time);
+        }
+        task.priority = std::max(task.priority, 1);
+        search->task = std::move(task);
+
+        int id;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            if (shutting_down)
+            {
+                spare_contexts.push_back(std::move(search->context));
+                return -1;
+            }
+            id = next_id++;
+            search->id = id;
+
+            // start level with the searches already running, so that it neither waits for them nor overtakes them
+            search->virtual_nodes = virtual_time;
+            for (std::unique_ptr<scheduled_search> &other : runnable) search->virtual_nodes = std::min(search->virtual_nodes, other->virtual_nodes);
+            runnable.push_back(std::move(search));
+        }
+        work_available.notify_one();
+        return id;
+    }
+
+    void SearchScheduler::wait_until_idle()
+    {
+        unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return runnable.empty() && running == 0; });
+    }
+
+    std::unique_ptr<SearchScheduler::scheduled_search> SearchScheduler::pick_next()
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto overdue = [&](const std::unique_ptr<scheduled_search> &search) { return search->has_deadline && search->deadline <= now; };
+        auto goes_before = [&](const std::unique_ptr<scheduled_search> &a, const std::unique_ptr<scheduled_search> &b)
+        {
+            if (overdue(a) != overdue(b)) return overdue(a);
+            if (overdue(a)) return a->deadline < b->deadline;
+            if (a->virtual_nodes != b->virtual_nodes) return a->virtual_nodes < b->virtual_nodes;
+            if (a->has_deadline != b->has_deadline) return a->has_deadline;
+            return a->deadline < b->deadline;
+        };
+
+        auto next = std::min_element(runnable.begin(), runnable.end(), goes_before);
+        std::unique_ptr<scheduled_search> search = std::move(*next);
+        *next = std::move(runnable.back());
+        runnable.pop_back();
+        virtual_time = std::max(virtual_time, search->virtual_nodes);
+        return search;
+    }
+
+    void SearchScheduler::worker_loop()
+    {
+        while (true)
+        {
+            std::unique_ptr<scheduled_search> search;
+            {
+                unique_lock<std::mutex> lock(mutex);
+                work_available.wait(lock, [this]() { return shutting_down || !runnable.empty(); });
+                if (shutting_down) return;
+                search = pick_next();
+                running++;
+            }
+
+            Engine &engine = search->context->engine();
+            if (!search->started)
+            {
+                // the move time left when the search first gets a worker
+                search_limits limits = search->task.limits;
+                auto now = std::chrono::steady_clock::now();
+                if (search->has_deadline) limits.move_time = std::max(milli_seconds_between(now, search->deadline), 1);
+                search->queue_milli_seconds = milli_seconds_between(search->submitted, now);
+                engine.start_search(search->context->position(), limits);
+                search->started = true;
+            }
+
+            U64 nodes_before = engine.nodes_searched();
+            bool finished = engine.search_step_nodes(slice_nodes);
+            search->slices++;
+            search->virtual_nodes += (double)(engine.nodes_searched() - nodes_before) / search->task.priority;
+
+            if (!finished)
+            {
+                {
+                    lock_guard<std::mutex> lock(mutex);
+                    running--;
+                    runnable.push_back(std::move(search));
+                }
+                work_available.notify_one();
+                continue;
+            }
+
+            search_outcome outcome = outcome_of(*search, false);
+            if (search->task.on_finished) search->task.on_finished(outcome);
+
+            {
+                lock_guard<std::mutex> lock(mutex);
+                spare_contexts.push_back(std::move(search->context));
+                running--;
+                if (runnable.empty() && running == 0) idle.notify_all();
+            }
+        }
+    }
+}
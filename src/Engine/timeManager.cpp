@@ -0,0 +1,99 @@
+#include "Engine/timeManager.h"
+
+#include <algorithm>
+#include <chrono>
+
+using std::min, std::max;
+
+
+namespace time_manager
+{
+    void TimeManager::start(const search_limits &limits)
+    {
+        start_time = std::chrono::steady_clock::now();
+        ponder_hit_time = start_time;
+        pondered = limits.ponder;
+        pondering.store(limits.ponder, std::memory_order_release);
+        previous_best_move = 0;
+        previous_evaluation = 0;
+        best_move_stability = 0;
+        limited = true;
+        fixed_time = false;
+
+        if (limits.move_time >= 0)
+        {
+            // a fixed move time is used as is
+            soft_limit = limits.move_time;
+            hard_limit = limits.move_time;
+            fixed_time = true;
+        }
+        else if (limits.time_left >= 0)
+        {
+            int available = max(1, limits.time_left - move_overhead);
+            int moves_to_go = limits.moves_to_go > 0 ? min(limits.moves_to_go, max_moves_to_go) : default_moves_to_go;
+
+            int optimum = available / moves_to_go + 3 * limits.increment / 4;
+            hard_limit = min(5 * optimum, available - available / 10);
+            soft_limit = min(optimum, hard_limit);
+        }
+        else
+        {
+            limited = false;
+        }
+        scaled_soft_limit = soft_limit;
+    }
+
+    void TimeManager::update(int depth, unsigned int best_move, int evaluation)
+    {
+        if (!limited || fixed_time) return;
+
+        if (best_move == previous_best_move)
+            best_move_stability = min(best_move_stability + 1, 8);
+        else
+            best_move_stability = 0;
+
+        // spend less time if the best move keeps being the same, more if it just changed
+        double stability_factor = best_move_stability == 0 ? 1.4 : best_move_stability >= 4 ? 0.6 : 1.0;
+
+        // spend more time if the score dropped since the last iteration
+        double score_factor = 1.0;
+        int score_drop = previous_evaluation - evaluation;
+        if (depth > 1 && score_drop > 20)
+            score_factor += min(score_drop, 150) / 150.0;
+
+        scaled_soft_limit = min((int)(soft_limit * stability_factor * score_factor), hard_limit);
+        previous_best_move = best_move;
+        previous_evaluation = evaluation;
+    }
+
+    bool TimeManager::soft_limit_reached()
+    {
+        // the time spent pondering counts as already used search time
+        if (pondering.load(std::memory_order_acquire)) return false;
+        return limited && elapsed_milli_seconds() >= scaled_soft_limit;
+    }
+
+    bool TimeManager::hard_limit_reached()
+    {
+        if (!limited || pondering.load(std::memory_order_acquire)) return false;
+
+        // our clock only runs after the ponder hit, so the hard limit is measured from there
+        int since_ponder_hit = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - ponder_hit_time).count();
+        if (since_ponder_hit >= hard_limit) return true;
+
+        // if the soft limit had passed already while pondering, the unfinished iteration is not worth waiting for
+        int pondering_time = std::chrono::duration_cast<std::chrono::milliseconds>(ponder_hit_time - start_time).count();
+        return pondered && pondering_time >= scaled_soft_limit;
+    }
+
+    void TimeManager::ponder_hit()
+    {
+        ponder_hit_time = std::chrono::steady_clock::now();
+        pondering.store(false, std::memory_order_release);
+    }
+
+    int TimeManager::elapsed_milli_seconds()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+    }
+}
@@ -1,96 +1,181 @@
 #include "Engine/transpositionTable.h"
 #include "utils.h"
+#include "simd.h"
 #include <array>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
 
 using namespace constants;
-using random_numbers::random_64_bit_number;
 using transposition_table::transposition_table_entry;
 
 using std::array;
+using std::vector;
 
 
-namespace zobrist
+namespace transposition_table
 {
-    array<array<U64, 12>, 64> zobrist_pieces;
-    U64 zobrist_side;
-    array<U64, 16> zobrist_castle;
-    array<U64, 64> zobrist_enpassant;
-    
-    void init_zobrist_keys()
+    // move in bits 0-26, evaluation in bits 27-44, depth in bits 45-52 and node type in bits 53-54
+    U64 pack_entry(U64 move, int depth, int node_type, int evaluation)
+    {
+        return (move & 0x7ffffffULL)
+             | ((U64)(evaluation + (1 << 17)) & 0x3ffffULL) << 27
+             | ((U64)(depth & 0xff)) << 45
+             | ((U64)node_type) << 53;
+    }
+
+    transposition_table_entry unpack_entry(U64 key, U64 data)
+    {
+        transposition_table_entry entry;
+        entry.zobrist_hash = key ^ data;
+        entry.best_move = data & 0x7ffffffULL;
+        entry.evaluation = (int)((data >> 27) & 0x3ffffULL) - (1 << 17);
+        entry.depth = (signed char)((data >> 45) & 0xff);
+        entry.node_type = (data >> 53) & 0x3;
+        return entry;
+    }
+
+    transposition_table_entry read_slot(const table_slot &slot)
+    {
+        return unpack_entry(slot.key.load(std::memory_order_relaxed), slot.data.load(std::memory_order_relaxed));
+    }
+
+    void write_slot(table_slot &slot, U64 zobrist_hash, U64 data)
+    {
+        slot.key.store(zobrist_hash ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+
+    TranspositionTable::TranspositionTable(size_t size_mb)
     {
-        for (int piece = P; piece <= k; piece++)
+        table_size = std::max<size_t>(size_mb * bytes_per_mb / (2 * sizeof(table_slot)), 1);
+        shallow_tt_table = std::make_unique<table_slot[]>(table_size);
+        deep_tt_table = std::make_unique<table_slot[]>(table_size);
+    }
+
+    void TranspositionTable::clear()
+    {
+        for (size_t i = 0; i < table_size; i++)
         {
-            for (int square = a8; square <= h1; square++)
-            {
-                zobrist_pieces[piece][square] = random_64_bit_number();
-            }
+            write_slot(shallow_tt_table[i], 0, 0);
+            write_slot(deep_tt_table[i], 0, 0);
         }
-        
-        for (int castle = 0; castle < 16; castle++)
+    }
+
+    void TranspositionTable::add_move_to_table(U64 zobrist_hash, U64 move, int depth, int node_type, int evaluation)
+    {
+        int index = zobrist_hash % table_size;
+        U64 data = pack_entry(move, depth, node_type, evaluation);
+        // if applicable, store in both the shallow and deep transposition tables
+        write_slot(shallow_tt_table[index], zobrist_hash, data);
+        if (read_slot(deep_tt_table[index]).depth <= depth)
         {
-            zobrist_castle[castle] = random_64_bit_number();
+            write_slot(deep_tt_table[index], zobrist_hash, data);
         }
+    }
+
+    int TranspositionTable::get_evaluation_from_table(U64 zobrist_hash, int depth, int alpha, int beta)
+    {
+        int index = zobrist_hash % table_size;
+        U64 keys[2] = {deep_tt_table[index].key.load(std::memory_order_relaxed), shallow_tt_table[index].key.load(std::memory_order_relaxed)};
+        U64 data[2] = {deep_tt_table[index].data.load(std::memory_order_relaxed), shallow_tt_table[index].data.load(std::memory_order_relaxed)};
 
-        for (int square = a8; square <= h1; square++)
+        // check the deep and the shallow entry at once
+        U64 matches[2];
+        simd::store(matches, simd::equal(simd::bit_xor(simd::load(keys), simd::load(data)), simd::splat(zobrist_hash)));
+        for (int i = 0; i < 2; i++)
         {
-            zobrist_enpassant[square] = random_64_bit_number();
+            if (!matches[i]) continue;
+            transposition_table_entry entry = unpack_entry(keys[i], data[i]);
+            if (entry.depth >= depth)
+            {
+                if (entry.node_type == exact) return entry.evaluation;
+                if (entry.node_type == lowerbound && entry.evaluation >= beta) return beta;
+                if (entry.node_type == upperbound && entry.evaluation <= alpha) return alpha;
+            }
         }
 
-        zobrist_side = random_64_bit_number();
+        return invalid_evaluation;
     }
-}
 
-namespace transposition_table
-{
-    array<transposition_table_entry, array_size> deep_tt_table;
-    array<transposition_table_entry, array_size> shallow_tt_table;
+    unsigned int TranspositionTable::get_move_from_table(U64 zobrist_hash)
+    {
+        // the move is not verified, so the caller has to check that it is legal
+        int index = zobrist_hash % table_size;
+        transposition_table_entry entry = read_slot(deep_tt_table[index]);
+        if (entry.zobrist_hash == zobrist_hash) return entry.best_move;
+        entry = read_slot(shallow_tt_table[index]);
+        if (entry.zobrist_hash == zobrist_hash) return entry.best_move;
+        return 0;
+    }
 
-    void add_move_to_table(U64 zobrist_hash, U64 move, int depth, int node_type, int evaluation)
+    int TranspositionTable::hashfull()
     {
-        int index = zobrist_hash % array_size;
-        // if applicable, store in both the shallow and deep transposition tables
-        transposition_table_entry shallow_entry = shallow_tt_table[index];
-        shallow_entry.zobrist_hash = zobrist_hash;
-        shallow_entry.best_move = move;
-        shallow_entry.depth = depth;
-        shallow_entry.node_type = node_type;
-        shallow_entry.evaluation = evaluation;
-        if (deep_tt_table[index].depth <= depth)
+        // permille of the deep table in use, estimated from its first thousand slots
+        int used = 0;
+        for (size_t i = 0; i < std::min<size_t>(1000, table_size); i++)
         {
-            transposition_table_entry deep_entry = deep_tt_table[index];
-            deep_entry.zobrist_hash = zobrist_hash;
-            deep_entry.best_move = move;
-            deep_entry.depth = depth;
-            deep_entry.node_type = node_type;
-            deep_entry.evaluation = evaluation;
+            if (deep_tt_table[i].key.load(std::memory_order_relaxed) != 0) used++;
         }
+        return used;
     }
 
-    int get_evaluation_from_table(U64 zobrist_hash, int depth, int alpha, int beta)
+    const size_t experience_block = 4096;  // entries per read or write
+
+    bool TranspositionTable::save_experience(const string &path, int min_depth)
     {
-        int index = zobrist_hash % array_size;
-        transposition_table_entry entry = deep_tt_table[index];
-        if (entry.zobrist_hash == zobrist_hash)
+        string temporary_path = path + ".tmp";
+        std::ofstream output(temporary_path, std::ios::binary);
+        output.write(reinterpret_cast<const char *>(&experience_magic), sizeof(U64));
+
+        vector<U64> block;
+        block.reserve(2 * experience_block);
+        for (size_t i = 0; i < table_size && output; i++)
         {
-            if (entry.depth >= depth)
+            transposition_table_entry entry = read_slot(deep_tt_table[i]);
+            if (entry.zobrist_hash == 0 || entry.depth < min_depth || abs(entry.evaluation) > check_mate_score - 1000) continue;
+            block.push_back(entry.zobrist_hash);
+            block.push_back(pack_entry(entry.best_move, entry.depth, entry.node_type, entry.evaluation));
+            if (block.size() == 2 * experience_block)
             {
-                if (entry.node_type == exact) return entry.evaluation;
-                if (entry.node_type == lowerbound && entry.evaluation <= alpha) return alpha;
-                if (entry.node_type == upperbound && entry.evaluation >= beta) return beta;
+                output.write(reinterpret_cast<const char *>(block.data()), block.size() * sizeof(U64));
+                block.clear();
             }
         }
+        output.write(reinterpret_cast<const char *>(block.data()), block.size() * sizeof(U64));
+        output.close();
 
-        entry = shallow_tt_table[index];
-        if (entry.zobrist_hash == zobrist_hash)
+        if (!output || std::rename(temporary_path.c_str(), path.c_str()) != 0)
         {
-            if (entry.depth >= depth)
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    size_t TranspositionTable::load_experience(const string &path)
+    {
+        std::ifstream input(path, std::ios::binary);
+        U64 magic = 0;
+        if (!input.read(reinterpret_cast<char *>(&magic), sizeof(U64)) || magic != experience_magic) return 0;
+
+        size_t loaded = 0;
+        vector<U64> block(2 * experience_block);
+        while (input)
+        {
+            input.read(reinterpret_cast<char *>(block.data()), block.size() * sizeof(U64));
+            size_t n_entries = input.gcount() / (2 * sizeof(U64));
+            for (size_t i = 0; i < n_entries; i++)
             {
-                if (entry.node_type == exact) return entry.evaluation;
-                if (entry.node_type == lowerbound && entry.evaluation <= alpha) return alpha;
-                if (entry.node_type == upperbound && entry.evaluation >= beta) return beta;
+                U64 zobrist_hash = block[2 * i];
+                transposition_table_entry entry = unpack_entry(zobrist_hash ^ block[2 * i + 1], block[2 * i + 1]);
+                if (entry.node_type > upperbound || entry.depth < 0) continue;
+                table_slot &slot = deep_tt_table[zobrist_hash % table_size];
+                if (read_slot(slot).depth < entry.depth) write_slot(slot, zobrist_hash, block[2 * i + 1]);
             }
+            loaded += n_entries;
         }
-
-        return invalid_evaluation;
+        return loaded;
     }
 }
@@ -1,8 +1,11 @@
 #include "MoveGenerator/AttackTables.h"
 #include "utils.h"
 #include "Engine/transpositionTable.h"
+#include "Engine/repetition.h"
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
 
 using std::fill;
 using std::cout;
@@ -11,7 +14,7 @@ using std::endl;
 using namespace bitboard_utils;
 using namespace constants;
 using namespace random_numbers;
-using zobrist::init_zobrist_keys;
+using repetition::init_cuckoo_tables;
 
 
 namespace piece_attacks
@@ -318,6 +321,25 @@ namespace piece_attacks
         }
     }
 
+    array<array<U64, 64>, 64> between_mask;
+
+    void _init_between_masks()
+    {
+        // squares strictly between two squares on the same rank, file or diagonal
+        for (int source = 0; source < 64; source++)
+        {
+            for (int target = 0; target < 64; target++)
+            {
+                between_mask[source][target] = 0ULL;
+                if (source == target) continue;
+                if (source / 8 == target / 8 || source % 8 == target % 8)
+                    between_mask[source][target] = rook_attacks(source, 1ULL << target) & rook_attacks(target, 1ULL << source);
+                else if (abs(source / 8 - target / 8) == abs(source % 8 - target % 8))
+                    between_mask[source][target] = bishop_attacks(source, 1ULL << target) & bishop_attacks(target, 1ULL << source);
+            }
+        }
+    }
+
     void init_all_attacks()
     {
         init_leaper_attacks();
@@ -326,9 +348,15 @@ namespace piece_attacks
 
     void init_all()
     {
-        init_all_attacks();
-        _init_align_masks();
-        init_zobrist_keys();
+        // the tables are shared by all engines and read-only afterwards, so they are filled once per process
+        static std::once_flag initialized;
+        std::call_once(initialized, []()
+        {
+            init_all_attacks();
+            _init_align_masks();
+            _init_between_masks();
+            init_cuckoo_tables();
+        });
     }
 }
 
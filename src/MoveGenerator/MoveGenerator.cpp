@@ -2,14 +2,13 @@
 #include "MoveGenerator/AttackTables.h"
 #include "utils.h"
 #include "Board/board.h"
+#include "simd.h"
 
 #include <iostream>
 #include <array>
 #include <span>
-#include <format>
 #include <chrono>
 
-using std::format;
 using std::cout;
 using std::endl;
 using std::span;
@@ -24,6 +23,7 @@ using piece_attacks::rook_attacks;
 using piece_attacks::queen_attacks;
 using piece_attacks::king_attacks;
 using piece_attacks::align_mask;
+using piece_attacks::between_mask;
 using piece_attacks::not_a_file;
 using piece_attacks::not_h_file;
 using board::board_state;
@@ -59,6 +59,150 @@ namespace move_generator
         return false;
     }
 
+    U64 attackers_to(int square, U64 occupancy, board_state &board)
+    {
+        // pieces of both sides attacking the square with the given occupancy,
+        // the diagonal sliders are handled in the low lane and the orthogonal ones in the high lane
+        simd::u64x2 sliders = simd::bit_or(simd::bit_or(simd::make(board.bitboards[B], board.bitboards[R]), simd::make(board.bitboards[b], board.bitboards[r])),
+                                           simd::splat(board.bitboards[Q] | board.bitboards[q]));
+        simd::u64x2 slider_attackers = simd::bit_and(simd::make(bishop_attacks(square, occupancy), rook_attacks(square, occupancy)), sliders);
+        return (pawn_attacks(square, black) & board.bitboards[P])
+            | (pawn_attacks(square, white) & board.bitboards[p])
+            | (knight_attacks(square) & (board.bitboards[N] | board.bitboards[n]))
+            | simd::low(slider_attackers) | simd::high(slider_attackers)
+            | (king_attacks(square) & (board.bitboards[K] | board.bitboards[k]));
+    }
+
+    bool see(board_state &board, unsigned int move, int threshold)
+    {
+        // static exchange evaluation, returns true if the exchange on the target square gains at least threshold
+        if (move_castle(move) || move_promotion(move) != no_promotion) return 0 >= threshold;
+
+        int source = move_source(move);
+        int target = move_target(move);
+        int captured = move_capture(move);
+        int balance = (captured == no_piece ? 0 : see_piece_values[captured % 6]) - threshold;
+        if (balance < 0) return false;  // even a free capture is not enough
+
+        balance = see_piece_values[move_piece(move) % 6] - balance;
+        if (balance <= 0) return true;  // the threshold is met even if the moved piece is lost
+
+        U64 occupancy = board.occupancies[both] ^ (1ULL << source) ^ (1ULL << target);
+        if (move_enpassant(move)) occupancy ^= 1ULL << (board.side == white ? target + 8 : target - 8);
+        U64 diagonal_sliders = board.bitboards[B] | board.bitboards[b] | board.bitboards[Q] | board.bitboards[q];
+        U64 orthogonal_sliders = board.bitboards[R] | board.bitboards[r] | board.bitboards[Q] | board.bitboards[q];
+        U64 attackers = attackers_to(target, occupancy, board);
+
+        // capture with the least valuable attacker in turns, sliders behind the removed pieces join as x-rays
+        int side = board.side;
+        bool result = true;
+        while (true)
+        {
+            side ^= 1;
+            attackers &= occupancy;
+            U64 side_attackers = attackers & board.occupancies[side];
+            if (!side_attackers) break;
+            result = !result;
+
+            int offset = side == white ? 0 : 6;
+            int piece;
+            for (piece = P; piece <= K; piece++)
+            {
+                if (side_attackers & board.bitboards[piece + offset]) break;
+            }
+            if (piece == K)
+            {
+                // the king can only capture if the opponent has no attackers left
+                return (attackers & ~board.occupancies[side]) ? !result : result;
+            }
+
+            balance = see_piece_values[piece] - balance;
+            if (balance < (int)result) break;
+
+            U64 attacker = side_attackers & board.bitboards[piece + offset];
+            occupancy ^= attacker & -attacker;
+            if (piece == P || piece == B || piece == Q)
+                attackers |= bishop_attacks(target, occupancy) & diagonal_sliders;
+            if (piece == R || piece == Q)
+                attackers |= rook_attacks(target, occupancy) & orthogonal_sliders;
+        }
+        return result;
+    }
+
+    check_info find_check_info(board_state &board)
+    {
+        check_info info = check_info{};
+        int enemy = board.side == white ? black : white;
+        int offset = board.side == white ? 0 : 6;
+        info.enemy_king = least_significant_bit_index(board.bitboards[board.side == white ? k : K]);
+        U64 occupancy = board.occupancies[both];
+
+        info.check_squares[P] = pawn_attacks(info.enemy_king, enemy);
+        info.check_squares[N] = knight_attacks(info.enemy_king);
+        info.check_squares[B] = bishop_attacks(info.enemy_king, occupancy);
+        info.check_squares[R] = rook_attacks(info.enemy_king, occupancy);
+        info.check_squares[Q] = info.check_squares[B] | info.check_squares[R];
+        info.check_squares[K] = 0ULL;
+
+        // own pieces standing alone between an own slider and the enemy king
+        U64 snipers = (bishop_attacks(info.enemy_king, 0ULL) & (board.bitboards[B + offset] | board.bitboards[Q + offset]))
+                    | (rook_attacks(info.enemy_king, 0ULL) & (board.bitboards[R + offset] | board.bitboards[Q + offset]));
+        while (snipers)
+        {
+            int square = least_significant_bit_index(snipers);
+            U64 blockers = between_mask[info.enemy_king][square] & occupancy;
+            if (blockers && count_bits(blockers) == 1)
+                info.discovered_check_blockers |= blockers & board.occupancies[board.side];
+            pop_bit(snipers, square);
+        }
+        return info;
+    }
+
+    bool gives_check(board_state &board, check_info &info, unsigned int move)
+    {
+        int source = move_source(move);
+        int target = move_target(move);
+        int piece = move_piece(move) % 6;
+        int offset = board.side == white ? 0 : 6;
+        U64 king_board = 1ULL << info.enemy_king;
+
+        // direct check
+        int promotion = move_promotion(move);
+        if (promotion == no_promotion)
+        {
+            if (info.check_squares[piece] & (1ULL << target)) return true;
+        }
+        else
+        {
+            U64 occupancy = board.occupancies[both] ^ (1ULL << source);
+            U64 attacks_board = promotion == promotion_queen ? queen_attacks(target, occupancy) :
+                                promotion == promotion_rook ? rook_attacks(target, occupancy) :
+                                promotion == promotion_bishop ? bishop_attacks(target, occupancy) : knight_attacks(target);
+            if (attacks_board & king_board) return true;
+        }
+
+        // discovered check by moving off the line to the enemy king
+        if (get_bit(info.discovered_check_blockers, source) && !(align_mask[source][info.enemy_king] & (1ULL << target))) return true;
+
+        // castling checks with the rook, en passant can uncover a check through both pawns
+        if (move_castle(move))
+        {
+            int rook_source = target > source ? source + 3 : source - 4;
+            int rook_target = target > source ? source + 1 : source - 1;
+            U64 occupancy = (board.occupancies[both] ^ (1ULL << source) ^ (1ULL << rook_source)) | (1ULL << target) | (1ULL << rook_target);
+            return (rook_attacks(rook_target, occupancy) & king_board) != 0;
+        }
+        if (move_enpassant(move))
+        {
+            int captured_square = board.side == white ? target + 8 : target - 8;
+            U64 occupancy = (board.occupancies[both] ^ (1ULL << source) ^ (1ULL << captured_square)) | (1ULL << target);
+            U64 diagonal_sliders = board.bitboards[B + offset] | board.bitboards[Q + offset];
+            U64 orthogonal_sliders = board.bitboards[R + offset] | board.bitboards[Q + offset];
+            return ((bishop_attacks(info.enemy_king, occupancy) & diagonal_sliders) | (rook_attacks(info.enemy_king, occupancy) & orthogonal_sliders)) != 0;
+        }
+        return false;
+    }
+
     bool in_check_after_en_passant(board_state &board, int source, int enemy_pawn_location)
     {
         U64 enemy_orthogonal_sliders = board.side == white ? (board.bitboards[q] | board.bitboards[r]) : (board.bitboards[Q] | board.bitboards[R]);
@@ -172,13 +316,70 @@ namespace move_generator
         cout << "Time taken: " << duration.count() << " ms" << endl;
     }
 
+    attack_info find_attack_info(board_state &board)
+    {
+        attack_info attack_map = attack_info{};
+        for (int side = white; side <= black; side++)
+        {
+            int offset = side == white ? 0 : 6;
+
+            // the king of the side to move is transparent, so that it can not step back along a checking ray
+            U64 occupancy = board.occupancies[both];
+            if (side != board.side) occupancy ^= board.bitboards[board.side == white ? K : k];
+
+            U64 pawns = board.bitboards[P + offset];
+            attack_map.attacks_by_piece[P + offset] = side == white ? ((pawns & not_a_file) >> 9) | ((pawns & not_h_file) >> 7)
+                                                                    : ((pawns & not_a_file) << 7) | ((pawns & not_h_file) << 9);
+            for (int piece = N; piece <= K; piece++)
+            {
+                U64 bitboard = board.bitboards[piece + offset];
+                U64 attacks_board = 0ULL;
+                while (bitboard)
+                {
+                    int square = least_significant_bit_index(bitboard);
+                    switch (piece)
+                    {
+                        case N: attacks_board |= knight_attacks(square); break;
+                        case B: attacks_board |= bishop_attacks(square, occupancy); break;
+                        case R: attacks_board |= rook_attacks(square, occupancy); break;
+                        case Q: attacks_board |= queen_attacks(square, occupancy); break;
+                        case K: attacks_board |= king_attacks(square); break;
+                    }
+                    pop_bit(bitboard, square);
+                }
+                attack_map.attacks_by_piece[piece + offset] = attacks_board;
+            }
+        }
+
+        // union the attacks of both sides at once, white in the low lane and black in the high lane
+        simd::u64x2 attacked = simd::splat(0ULL);
+        for (int piece = P; piece <= K; piece++)
+            attacked = simd::bit_or(attacked, simd::make(attack_map.attacks_by_piece[piece], attack_map.attacks_by_piece[piece + 6]));
+        simd::store(attack_map.attacked.data(), attacked);
+        simd::store(attack_map.king_zone.data(), simd::bit_or(simd::make(attack_map.attacks_by_piece[K], attack_map.attacks_by_piece[k]),
+                                                              simd::make(board.bitboards[K], board.bitboards[k])));
+        return attack_map;
+    }
+
+    bool in_check(board_state &board, attack_info &attack_map)
+    {
+        int enemy = board.side == white ? black : white;
+        return (attack_map.attacked[enemy] & board.bitboards[board.side == white ? K : k]) != 0;
+    }
+
     span<unsigned int> generate_moves(board_state &board, array<unsigned int, max_moves> &move_list, bool no_quiet_moves)
+    {
+        attack_info attack_map = find_attack_info(board);
+        return generate_moves(board, move_list, no_quiet_moves, attack_map);
+    }
+
+    span<unsigned int> generate_moves(board_state &board, array<unsigned int, max_moves> &move_list, bool no_quiet_moves, attack_info &attack_map)
     {
         king_info info = _find_check_and_pin_masks(board);
 
         span<unsigned int> moves_list(move_list);
         int move_index = 0;
-        _generate_king_moves(board, info, no_quiet_moves, moves_list, move_index);
+        _generate_king_moves(board, attack_map, no_quiet_moves, moves_list, move_index);
 
         // skip other moves as only king moves are possible in double check
         if (info.n_checks < 2)
@@ -331,25 +532,21 @@ namespace move_generator
         }
     }
 
-    void _generate_king_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index)
+    void _generate_king_moves(board_state &board, attack_info &attack_map, bool no_quiet_moves, span<unsigned int> moves, int &move_index)
     {
         int piece = (board.side == white) ? K : k;
         int rook = (board.side == white) ? R : r;
         int enemy_color = (board.side == white) ? black : white;
+        U64 attacked = attack_map.attacked[enemy_color];
 
-        // before using is_square_attacked, remove own king from the board
-        U64 king_bitboard = board.bitboards[piece];
-        int king_location = least_significant_bit_index(king_bitboard);
-        board.bitboards[piece] = 0ULL;
-        board.occupancies[board.side] ^= king_bitboard;
-        board.occupancies[both] ^= king_bitboard;
+        int king_location = least_significant_bit_index(board.bitboards[piece]);
 
         if (board.side == white && !no_quiet_moves)
         {
             // white kingside castle
             int castling_available = board.castle & wk;
             bool no_pieces_between = !get_bit(board.occupancies[both], f1) && !get_bit(board.occupancies[both], g1);
-            bool king_not_through_check = !is_square_attacked(e1, board) && !is_square_attacked(f1, board) && !is_square_attacked(g1, board);
+            bool king_not_through_check = !get_bit(attacked, e1) && !get_bit(attacked, f1) && !get_bit(attacked, g1);
             bool king_and_rook_present = king_location == e1 && get_bit(board.bitboards[rook], h1);
             if (castling_available && no_pieces_between && king_not_through_check && king_and_rook_present)
             {
@@ -359,7 +556,7 @@ namespace move_generator
             // white queenside castle
             castling_available = board.castle & wq;
             no_pieces_between = !get_bit(board.occupancies[both], d1) && !get_bit(board.occupancies[both], c1) && !get_bit(board.occupancies[both], b1);
-            king_not_through_check = !is_square_attacked(e1, board) && !is_square_attacked(d1, board) && !is_square_attacked(c1, board);
+            king_not_through_check = !get_bit(attacked, e1) && !get_bit(attacked, d1) && !get_bit(attacked, c1);
             king_and_rook_present = king_location == e1 && get_bit(board.bitboards[rook], a1);
             if (castling_available && no_pieces_between && king_not_through_check && king_and_rook_present)
             {
@@ -371,7 +568,7 @@ namespace move_generator
             // black kingside castle
             int castling_available = board.castle & bk;
             bool no_pieces_between = !get_bit(board.occupancies[both], f8) && !get_bit(board.occupancies[both], g8);
-            bool king_not_through_check = !is_square_attacked(e8, board) && !is_square_attacked(f8, board) && !is_square_attacked(g8, board);
+            bool king_not_through_check = !get_bit(attacked, e8) && !get_bit(attacked, f8) && !get_bit(attacked, g8);
             bool king_and_rook_present = king_location == e8 && get_bit(board.bitboards[rook], h8);
             if (castling_available && no_pieces_between && king_not_through_check && king_and_rook_present)
             {
@@ -381,7 +578,7 @@ namespace move_generator
             // black queenside castle
             castling_available = board.castle & bq;
             no_pieces_between = !get_bit(board.occupancies[both], d8) && !get_bit(board.occupancies[both], c8) && !get_bit(board.occupancies[both], b8);
-            king_not_through_check = !is_square_attacked(e8, board) && !is_square_attacked(d8, board) && !is_square_attacked(c8, board);
+            king_not_through_check = !get_bit(attacked, e8) && !get_bit(attacked, d8) && !get_bit(attacked, c8);
             king_and_rook_present = king_location == e8 && get_bit(board.bitboards[rook], a8);
             if (castling_available && no_pieces_between && king_not_through_check && king_and_rook_present)
             {
@@ -389,31 +586,22 @@ namespace move_generator
             }
         }
 
-        // normal king moves
-        U64 bitboard = king_bitboard;
-        U64 attacks_board = king_attacks(king_location) & ~board.occupancies[board.side];
+        // normal king moves to squares not attacked by the enemy
+        U64 attacks_board = king_attacks(king_location) & ~board.occupancies[board.side] & ~attacked;
         if (no_quiet_moves)
             attacks_board &= board.occupancies[enemy_color];
 
         while (attacks_board)
         {
             int target = least_significant_bit_index(attacks_board);
-            if (!is_square_attacked(target, board))
-            {
-                if (!get_bit(board.occupancies[enemy_color], target))
-                    // non-capture
-                    moves[move_index++] = encode_move(king_location, target, piece, no_promotion, no_piece, 0, 0, 0);
-                else
-                    // capture
-                    moves[move_index++] = encode_move(king_location, target, piece, no_promotion, find_captured_piece(board, target), 0, 0, 0);
-            }
+            if (!get_bit(board.occupancies[enemy_color], target))
+                // non-capture
+                moves[move_index++] = encode_move(king_location, target, piece, no_promotion, no_piece, 0, 0, 0);
+            else
+                // capture
+                moves[move_index++] = encode_move(king_location, target, piece, no_promotion, find_captured_piece(board, target), 0, 0, 0);
             pop_bit(attacks_board, target);
         }
-
-        // put the friendly king back on the board
-        board.bitboards[piece] = king_bitboard;
-        board.occupancies[board.side] ^= king_bitboard;
-        board.occupancies[both] ^= king_bitboard;
     }
 
     void _generate_knight_moves(board_state &board, king_info &info, bool no_quiet_moves, span<unsigned int> moves, int &move_index)
@@ -526,112 +714,37 @@ namespace move_generator
     {
         king_info info = king_info{};
 
-        int king = (board.side == white) ? K : k;
-        int king_location = least_significant_bit_index(board.bitboards[king]);
-        U64 own_pieces = (board.side == white) ? board.occupancies[white] : board.occupancies[black];
-        U64 enemy_pieces = (board.side == white) ? board.occupancies[black] : board.occupancies[white];
-        int king_row = king_location / 8;
-        int king_file = king_location % 8;
-        int _r, _f;
-        int square;
-        
-        // check sliders for pins or checks
-        array<array<int, 2>, 8> offsets = {{{1, 1}, {1, -1}, {-1, 1}, {-1, -1}, {1, 0}, {-1, 0}, {0, 1}, {0, -1}}};
-        for (int i = 0; i < offsets.size(); i++)
-        {
-            bool is_diagonal = i < 4;
-            U64 possible_checkers;
-            U64 ray_mask = 0ULL;
-            if (board.side == white)
-            {
-                // if diagonals then bishop and queen else rook and queen
-                possible_checkers = is_diagonal ? board.bitboards[b] : board.bitboards[r];
-                possible_checkers |= board.bitboards[q];
-            }
-            else
-            {
-                // if diagonals then bishop and queen else rook and queen
-                possible_checkers = is_diagonal ? board.bitboards[B] : board.bitboards[R];
-                possible_checkers |= board.bitboards[Q];
-            }
-            if (count_bits(possible_checkers) == 0) continue;  // continue if no possible checking pieces in this direction
-
-            int n_blockers = 0;
-            int k = 1;
-            _r = king_row;
-            _f = king_file;
-            while (king_row + k * offsets[i][0] >= 0 && king_row + k * offsets[i][0] <= 7 && king_file + k * offsets[i][1] >= 0 && king_file + k * offsets[i][1] <= 7)
-            {
-                _r = king_row + k * offsets[i][0];
-                _f = king_file + k * offsets[i][1];
-                square = 8 * _r + _f;
-                set_bit(ray_mask, square);
-                if (get_bit(board.occupancies[both], square) == 0)  // no piece
-                {
-                    k++;
-                    continue;
-                }
-                if (get_bit(possible_checkers, square) && n_blockers == 0)  // check
-                {
-                    info.n_checks++;
-                    if (info.n_checks >= 2) return info;  // if in double check, we can return early as only king is able to move
-                    info.check_rays |= ray_mask;
-                    break;
-                }
-                if (get_bit(own_pieces, square))  // own piece
-                {
-                    n_blockers++;
-                    if (n_blockers >= 2) break;
-                    k++;
-                    continue;
-                }
-                bool diagonal_pin = is_diagonal && (get_bit((board.side == white) ? (board.bitboards[q] | board.bitboards[b]) : (board.bitboards[Q] | board.bitboards[B]), square));
-                bool orthogonal_pin = !is_diagonal && (get_bit((board.side == white) ? (board.bitboards[q] | board.bitboards[r]) : (board.bitboards[Q] | board.bitboards[R]), square));
-                bool enemy_piece_with_blocker = get_bit(enemy_pieces, square) && n_blockers == 1;
-                if (enemy_piece_with_blocker && (diagonal_pin || orthogonal_pin))  // enemy piece, which pins
-                {
-                    info.pin_rays |= ray_mask;
-                    break;
-                }
-                break;  // enemy piece, which does not check or give a pin
-            }
-        }
+        int offset = (board.side == white) ? 6 : 0;  // offset of the enemy pieces
+        int king_location = least_significant_bit_index(board.bitboards[(board.side == white) ? K : k]);
+        U64 own_pieces = board.occupancies[board.side];
+        U64 occupancy = board.occupancies[both];
 
-        // knight checks
-        U64 enemy_knights = (board.side == white) ? board.bitboards[n] : board.bitboards[N];
-        U64 attacks_board = knight_attacks(king_location);
-        while (attacks_board)
+        // enemy sliders on a line with the king either check or pin a single own piece in between
+        U64 snipers = (bishop_attacks(king_location, 0ULL) & (board.bitboards[B + offset] | board.bitboards[Q + offset]))
+                    | (rook_attacks(king_location, 0ULL) & (board.bitboards[R + offset] | board.bitboards[Q + offset]));
+        while (snipers)
         {
-            square = least_significant_bit_index(attacks_board);
-            if (get_bit(enemy_knights, square))
+            int square = least_significant_bit_index(snipers);
+            U64 ray_mask = between_mask[king_location][square];
+            U64 blockers = ray_mask & occupancy;
+            if (blockers == 0ULL)
             {
                 info.n_checks++;
-                if (info.n_checks >= 2) return info;
-                set_bit(info.check_rays, square);
+                info.check_rays |= ray_mask | (1ULL << square);
             }
-            pop_bit(attacks_board, square);
+            else if ((blockers & (blockers - 1)) == 0 && (blockers & own_pieces))
+            {
+                info.pin_rays |= ray_mask | (1ULL << square);
+            }
+            pop_bit(snipers, square);
         }
+        if (info.n_checks >= 2) return info;  // if in double check, we can return early as only king is able to move
 
-        // pawn checks
-        U64 possible_checks;
-        if (board.side == white)
-        {
-            attacks_board = pawn_attacks(king_location, white);
-            possible_checks = board.bitboards[p] & attacks_board;
-        }
-        else
-        {
-            attacks_board = pawn_attacks(king_location, black);
-            possible_checks = board.bitboards[P] & attacks_board;
-        }
-        while (possible_checks)
-        {
-            square = least_significant_bit_index(possible_checks);
-            info.n_checks++;
-            if (info.n_checks >= 2) return info;
-            set_bit(info.check_rays, square);
-            pop_bit(possible_checks, square);
-        }
+        // knight and pawn checks
+        U64 checkers = (knight_attacks(king_location) & board.bitboards[N + offset])
+                     | (pawn_attacks(king_location, board.side) & board.bitboards[P + offset]);
+        info.n_checks += count_bits(checkers);
+        info.check_rays |= checkers;
 
         // if no checks, all moves should be possible
         if (info.n_checks == 0)
@@ -0,0 +1,522 @@
+#include "Tools/analysisServer.h"
+#include "engineContext.h"
+#include "uci.h"
+#include "Engine/engine.h"
+#include "Engine/transpositionTable.h"
+#include "Engine/searchScheduler.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <cctype>
+#include <cstring>
+#include <climits>
+#include <csignal>
+#include <cerrno>
+#include <map>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::to_string;
+
+using piece_attacks::init_all;
+using transposition_table::TranspositionTable;
+using search_scheduler::SearchScheduler;
+using search_scheduler::search_task;
+using search_scheduler::search_outcome;
+
+
+namespace analysis_server
+{
+    const int default_move_time = 1000;  // used when a request gives no limit, so that a search always ends
+
+    // a reader for the flat request objects, values are strings, numbers, literals or arrays of strings
+    struct json_reader {
+        const string &text;
+        size_t position = 0;
+
+        void skip_whitespace()
+        {
+            while (position < text.size() && std::isspace((unsigned char)text[position])) position++;
+        }
+
+        bool consume(char character)
+        {
+            skip_whitespace();
+            if (position >= text.size() || text[position] != character) return false;
+            position++;
+            return true;
+        }
+
+        bool read_hex(unsigned int &code)
+        {
+            if (text.size() - position < 4) return false;
+            code = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char digit = text[position++];
+                if (!std::isxdigit((unsigned char)digit)) return false;
+                code = code * 16 + (std::isdigit((unsigned char)digit) ? digit - '0' : std::tolower((unsigned char)digit) - 'a' + 10);
+            }
+            return true;
+        }
+
+        void append_utf8(string &value, unsigned int code)
+        {
+            if (code < 0x80) value += (char)code;
+            else if (code < 0x800) value += {(char)(0xc0 | code >> 6), (char)(0x80 | (code & 0x3f))};
+            else if (code < 0x10000) value += {(char)(0xe0 | code >> 12), (char)(0x80 | ((code >> 6) & 0x3f)), (char)(0x80 | (code & 0x3f))};
+            else value += {(char)(0xf0 | code >> 18), (char)(0x80 | ((code >> 12) & 0x3f)), (char)(0x80 | ((code >> 6) & 0x3f)), (char)(0x80 | (code & 0x3f))};
+        }
+
+        bool read_string(string &value)
+        {
+            if (!consume('"')) return false;
+            value.clear();
+            while (position < text.size() && text[position] != '"')
+            {
+                char character = text[position++];
+                if ((unsigned char)character < 0x20) return false;  // control characters have to be escaped
+                if (character != '\\')
+                {
+                    value += character;
+                    continue;
+                }
+                if (position >= text.size()) return false;
+                char escaped = text[position++];
+                const char *escapes = "\"\\/bfnrt";
+                const char *replacements = "\"\\/\b\f\n\r\t";
+                if (escaped == 'u')
+                {
+                    // a code point beyond the basic plane is written as a pair of surrogates
+                    unsigned int code, low;
+                    if (!read_hex(code)) return false;
+                    if (code >= 0xd800 && code < 0xdc00)
+                    {
+                        if (text.compare(position, 2, "\\u") != 0) return false;
+                        position += 2;
+                        if (!read_hex(low) || low < 0xdc00 || low >= 0xe000) return false;
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    else if (code >= 0xdc00 && code < 0xe000) return false;
+                    append_utf8(value, code);
+                }
+                else if (escaped != '\0' && strchr(escapes, escaped)) value += replacements[strchr(escapes, escaped) - escapes];
+                else return false;
+            }
+            return consume('"');
+        }
+
+        bool read_raw_value(string &value)
+        {
+            // a number or a literal, kept as text
+            skip_whitespace();
+            size_t start = position;
+            while (position < text.size() && (std::isalnum((unsigned char)text[position]) || strchr("+-.", text[position]))) position++;
+            value = text.substr(start, position - start);
+            return !value.empty();
+        }
+    };
+
+    bool parse_number(const string &text, long long &value)
+    {
+        try
+        {
+            size_t length;
+            value = std::stoll(text, &length);
+            return length == text.size();
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+
+    bool is_json_number(const string &text)
+    {
+        // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+        size_t i = 0;
+        auto digits = [&]() { size_t start = i; while (i < text.size() && std::isdigit((unsigned char)text[i])) i++; return i > start; };
+        if (i < text.size() && text[i] == '-') i++;
+        if (i < text.size() && text[i] == '0') i++;
+        else if (!digits()) return false;
+        if (i < text.size() && text[i] == '.' && (++i, !digits())) return false;
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E'))
+        {
+            i++;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-')) i++;
+            if (!digits()) return false;
+        }
+        return i == text.size();
+    }
+
+    bool parse_request(const string &line, analysis_request &request, string &error)
+    {
+        json_reader reader{line};
+        if (!reader.consume('{'))
+        {
+            error = "expected a json object";
+            return false;
+        }
+
+        bool first = true;
+        while (!reader.consume('}'))
+        {
+            if (!first && !reader.consume(','))
+            {
+                error = "expected ',' between the members";
+                return false;
+            }
+            first = false;
+
+            string key;
+            if (!reader.read_string(key) || !reader.consume(':'))
+            {
+                error = "expected a member name";
+                return false;
+            }
+
+            reader.skip_whitespace();
+            if (key == "moves" && reader.position < line.size() && line[reader.position] == '[')
+            {
+                reader.consume('[');
+                string move;
+                while (!reader.consume(']'))
+                {
+                    if (!request.moves.empty() && !reader.consume(','))
+                    {
+                        error = "expected ',' between the moves";
+                        return false;
+                    }
+                    if (!reader.read_string(move))
+                    {
+                        error = "expected a move";
+                        return false;
+                    }
+                    request.moves.push_back(move);
+                }
+                continue;
+            }
+
+            string value;
+            size_t value_start = reader.position;
+            bool is_string = reader.position < line.size() && line[reader.position] == '"';
+            if (is_string ? !reader.read_string(value) : !reader.read_raw_value(value))
+            {
+                error = "invalid value for " + key;
+                return false;
+            }
+
+            long long number = 0;
+            if (key == "id")
+            {
+                // kept with its escapes, so that it is echoed exactly as it was sent
+                if (!is_string && !is_json_number(value))
+                {
+                    error = "id has to be a string or a number";
+                    return false;
+                }
+                request.id = line.substr(value_start, reader.position - value_start);
+            }
+            else if (key == "fen") request.fen = value;
+            else if (key == "moves")
+            {
+                // also accepted as a space separated string
+                size_t start = 0;
+                while (start < value.size())
+                {
+                    size_t end = value.find(' ', start);
+                    if (end == string::npos) end = value.size();
+                    if (end > start) request.moves.push_back(value.substr(start, end - start));
+                    start = end + 1;
+                }
+            }
+            else if (key == "movetime" || key == "depth" || key == "nodes" || key == "multipv" || key == "priority")
+            {
+                // all but the node count are stored as int
+                long long max_value = key == "nodes" ? LLONG_MAX : INT_MAX;
+                if (!parse_number(value, number) || number <= 0 || number > max_value)
+                {
+                    error = key + " has to be a positive integer up to " + to_string(max_value);
+                    return false;
+                }
+                if (key == "movetime") request.move_time = number;
+                if (key == "depth") request.depth = number;
+                if (key == "nodes") request.nodes = number;
+                if (key == "multipv") request.multi_pv = number;
+                if (key == "priority") request.priority = number;
+            }
+        }
+        return true;
+    }
+
+    string escape(const string &text)
+    {
+        string escaped;
+        for (char character : text)
+        {
+            if (character == '"' || character == '\\') escaped += '\\';
+            escaped += character;
+        }
+        return escaped;
+    }
+
+    string moves_to_json(const vector<unsigned int> &moves)
+    {
+        string json = "[";
+        for (size_t i = 0; i < moves.size(); i++)
+        {
+            if (i > 0) json += ",";
+            json += "\"" + uci::move_to_uci(moves[i]) + "\"";
+        }
+        return json + "]";
+    }
+
+    // a connection receives the lines of one request at a time, so the writes only need to be whole lines
+    bool send_line(int socket, const string &line)
+    {
+        string data = line + "\n";
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+#ifdef MSG_NOSIGNAL
+            ssize_t result = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#else
+            ssize_t result = send(socket, data.data() + sent, data.size() - sent, 0);
+#endif
+            if (result <= 0) return false;
+            sent += result;
+        }
+        return true;
+    }
+
+    string info_to_json(const string &id, const search_info &info)
+    {
+        int mate = uci::mate_distance(info.evaluation);
+        string score = uci::is_mate_score(info.evaluation) ? "\"mate\":" + to_string(mate) : "\"cp\":" + to_string(info.evaluation);
+        return "{\"id\":" + id + ",\"type\":\"info\",\"depth\":" + to_string(info.depth)
+            + ",\"seldepth\":" + to_string(info.selective_depth) + ",\"multipv\":" + to_string(info.multi_pv)
+            + ",\"score\":{" + score + "},\"nodes\":" + to_string(info.nodes) + ",\"nps\":" + to_string(info.nodes_per_second)
+            + ",\"time\":" + to_string(info.time) + ",\"hashfull\":" + to_string(info.hashfull)
+            + ",\"pv\":" + moves_to_json(info.principal_variation) + "}";
+    }
+
+    bool analyse(SearchScheduler &scheduler, int socket, const analysis_request &request)
+    {
+        search_task task;
+        task.fen = request.fen;
+        task.moves = request.moves;
+        task.limits.move_time = request.move_time;
+        task.limits.depth = request.depth;
+        task.limits.nodes = request.nodes;
+        if (task.limits.move_time < 0 && task.limits.depth < 0 && task.limits.nodes < 0) task.limits.move_time = default_move_time;
+        task.priority = request.priority;
+        task.multi_pv = request.multi_pv;
+
+        // stream the progress as it arrives, the lines of one search come from one slice at a time
+        string id = request.id;
+        task.on_info = [socket, id](const search_info &info) { send_line(socket, info_to_json(id, info)); };
+
+        std::promise<void> done;
+        task.on_finished = [socket, id, &done](const search_outcome &outcome) {
+            string result = "{\"id\":" + id + ",\"type\":\"bestmove\",\"bestmove\":";
+            result += outcome.best_move != 0 ? "\"" + uci::move_to_uci(outcome.best_move) + "\"" : "null";
+            result += ",\"ponder\":";
+            result += outcome.ponder_move != 0 ? "\"" + uci::move_to_uci(outcome.ponder_move) + "\"" : "null";
+            if (outcome.stopped) result += ",\"stopped\":true";
+            send_line(socket, result + "}");
+            done.set_value();
+        };
+
+        std::future<void> finished = done.get_future();
+        if (scheduler.submit(task) < 0) return false;
+        finished.wait();
+        return true;
+    }
+
+    volatile std::sig_atomic_t stop_signal = 0;
+
+    void on_stop_signal(int) { stop_signal = 1; }
+
+    struct connection_list {
+        // the threads of the open connections by socket. a thread puts its socket on the finished list
+        // when it ends, and the socket is closed only after the thread is joined, so it cannot be reused earlier
+        std::mutex mutex;
+        std::map<int, std::thread> threads;
+        vector<int> finished;
+    };
+
+    void connection_loop(int socket, SearchScheduler &scheduler, connection_list &connections)
+    {
+        // requests of one connection are answered in order, different connections are served in parallel
+        string buffer;
+        char chunk[4096];
+        while (true)
+        {
+            ssize_t received = recv(socket, chunk, sizeof(chunk), 0);
+            if (received <= 0) break;
+            buffer.append(chunk, received);
+
+            size_t end;
+            while ((end = buffer.find('\n')) != string::npos)
+            {
+                string line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                if (line.find_first_not_of(" \t\r") == string::npos) continue;
+
+                analysis_request request;
+                string error;
+                if (!parse_request(line, request, error))
+                {
+                    send_line(socket, "{\"id\":" + request.id + ",\"type\":\"error\",\"error\":\"" + escape(error) + "\"}");
+                    continue;
+                }
+                if (!analyse(scheduler, socket, request))
+                {
+                    string error = stop_signal ? "server is shutting down" : "invalid fen or illegal move";
+                    send_line(socket, "{\"id\":" + request.id + ",\"type\":\"error\",\"error\":\"" + error + "\"}");
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(connections.mutex);
+        connections.finished.push_back(socket);
+    }
+
+    void join_finished(connection_list &connections)
+    {
+        vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(connections.mutex);
+            for (int socket : connections.finished)
+            {
+                threads.push_back(std::move(connections.threads[socket]));
+                connections.threads.erase(socket);
+                close(socket);
+            }
+            connections.finished.clear();
+        }
+        for (std::thread &thread : threads) thread.join();
+    }
+
+    int open_listening_socket(const server_options &options)
+    {
+        int listener;
+        if (!options.socket_path.empty())
+        {
+            listener = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, options.socket_path.c_str(), sizeof(address.sun_path) - 1);
+            unlink(options.socket_path.c_str());
+            if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0) return -1;
+        }
+        else
+        {
+            listener = socket(AF_INET, SOCK_STREAM, 0);
+            int reuse = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(options.port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // local only, the server has no authentication
+            if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) < 0) return -1;
+        }
+        if (listen(listener, 64) < 0) return -1;
+        return listener;
+    }
+
+    int run(const server_options &options)
+    {
+        std::signal(SIGPIPE, SIG_IGN);  // a client closing its connection must not end the server
+        init_all();
+
+        // the stop signals are blocked in every thread and only delivered while the accept loop waits in pselect,
+        // so that the loop sees them without a race. the threads started below inherit the blocked mask
+        sigset_t stop_signals, waiting_mask;
+        sigemptyset(&stop_signals);
+        sigaddset(&stop_signals, SIGINT);
+        sigaddset(&stop_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &stop_signals, &waiting_mask);
+        sigdelset(&waiting_mask, SIGINT);
+        sigdelset(&waiting_mask, SIGTERM);
+        struct sigaction action{};
+        action.sa_handler = on_stop_signal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        int listener = open_listening_socket(options);
+        if (listener < 0)
+        {
+            cerr << "could not listen on " << (options.socket_path.empty() ? "port " + to_string(options.port) : options.socket_path) << endl;
+            return 1;
+        }
+
+        // the engines and the table are created once and reused for every request
+        int workers = std::max(options.workers, 1);
+        SearchScheduler scheduler(workers, std::make_shared<TranspositionTable>(options.hash_mb));
+        cout << "analysis server listening on " << (options.socket_path.empty() ? "127.0.0.1:" + to_string(options.port) : options.socket_path)
+             << " with " << workers << " workers" << endl;
+
+        connection_list connections;
+        int max_connections = std::max(options.max_connections, 1);
+        while (!stop_signal)
+        {
+            join_finished(connections);
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            if (pselect(listener + 1, &readable, nullptr, nullptr, nullptr, &waiting_mask) <= 0) continue;  // EINTR after a signal
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0) continue;
+
+            // a client that stops reading must not block the thread that answers it, or the shutdown below
+            timeval send_timeout{10, 0};
+            setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+            std::lock_guard<std::mutex> lock(connections.mutex);
+            if ((int)(connections.threads.size() - connections.finished.size()) >= max_connections)
+            {
+                send_line(connection, "{\"id\":null,\"type\":\"error\",\"error\":\"too many connections\"}");
+                close(connection);
+                continue;
+            }
+            connections.threads[connection] = std::thread(connection_loop, connection, std::ref(scheduler), std::ref(connections));
+        }
+
+        // no new connections or requests, the running searches are answered as stopped and every thread is joined
+        close(listener);
+        if (!options.socket_path.empty()) unlink(options.socket_path.c_str());
+        {
+            std::lock_guard<std::mutex> lock(connections.mutex);
+            for (auto &[socket, thread] : connections.threads) shutdown(socket, SHUT_RD);
+        }
+        scheduler.shutdown();
+        std::map<int, std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(connections.mutex);
+            threads.swap(connections.threads);
+        }
+        for (auto &[socket, thread] : threads)
+        {
+            thread.join();
+            close(socket);
+        }
+        cout << "analysis server stopped" << endl;
+        return 0;
+    }
+}
@@ -0,0 +1,259 @@
+#include "Tools/batchAnalysis.h"
+#include "engineContext.h"
+#include "uci.h"
+#include "Engine/engine.h"
+#include "Engine/transpositionTable.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::to_string;
+
+using piece_attacks::init_all;
+using transposition_table::TranspositionTable;
+
+
+namespace batch_analysis
+{
+    const int default_depth = 8;  // used when no limit is given
+    const int pending_per_thread = 256;  // positions read ahead of the output, bounds the memory for any input size
+    const int progress_interval = 10;  // seconds between the progress reports
+
+    struct epd_record {
+        string position;  // the fen, with the clocks if the line had them
+        string id;  // the id operation, as it was written
+    };
+
+    bool is_number(const string &text)
+    {
+        if (text.empty()) return false;
+        for (char character : text) if (!std::isdigit((unsigned char)character)) return false;
+        return true;
+    }
+
+    string trim(const string &text)
+    {
+        size_t start = text.find_first_not_of(" \t\r");
+        if (start == string::npos) return "";
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(start, end - start + 1);
+    }
+
+    bool parse_record(const string &line, epd_record &record)
+    {
+        std::istringstream stream(line);
+        vector<string> fields(4);
+        for (string &field : fields) if (!(stream >> field)) return false;
+        if (fields[1] != "w" && fields[1] != "b") return false;
+        if (std::count(fields[0].begin(), fields[0].end(), '/') != 7) return false;
+        record.position = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3];
+
+        // a fen continues with the two clocks, an epd record with its operations
+        string rest;
+        std::getline(stream, rest);
+        std::istringstream clocks(rest);
+        string halfmove_clock, fullmove_number;
+        if (clocks >> halfmove_clock >> fullmove_number && is_number(halfmove_clock) && is_number(fullmove_number))
+        {
+            record.position += " " + halfmove_clock + " " + fullmove_number;
+            std::getline(clocks, rest);
+        }
+
+        size_t start = 0;
+        while (start < rest.size())
+        {
+            size_t end = rest.find(';', start);
+            if (end == string::npos) end = rest.size();
+            string operation = trim(rest.substr(start, end - start));
+            if (operation.rfind("id ", 0) == 0) record.id = operation;
+            start = end + 1;
+        }
+        return true;
+    }
+
+    string analyse(EngineContext &context, const string &line, const search_limits &limits, U64 &nodes)
+    {
+        epd_record record;
+        if (!parse_record(line, record) || !context.set_position(record.position)) return trim(line) + " ; error \"invalid position\";";
+
+        // every position starts from empty tables, so that its result does not depend on the positions
+        // the same worker analysed before it. a mate or stalemate is not searched and gets dm 0 or ce 0
+        Engine &engine = context.engine();
+        engine.get_transposition_table()->clear();
+        engine.clear_move_ordering();
+        int evaluation = engine.iterative_search(context.position(), limits);
+        nodes = engine.nodes_searched();
+
+        string result = record.position;
+        unsigned int best_move = engine.best_move();
+        if (best_move != 0) result += " bm " + uci::move_to_uci(best_move) + ";";
+
+        // a side that is mated already gets dm 0
+        int mate = uci::mate_distance(evaluation);
+        result += uci::is_mate_score(evaluation) ? " dm " + to_string(mate) + ";" : " ce " + to_string(evaluation) + ";";
+
+        const vector<principal_variation> &lines = engine.get_principal_variations();
+        if (!lines.empty())
+        {
+            result += " acd " + to_string(lines[0].depth) + ";";
+        }
+        result += " acn " + to_string(nodes) + ";";
+        if (!lines.empty() && !lines[0].moves.empty())
+        {
+            result += " pv";
+            for (unsigned int move : lines[0].moves) result += " " + uci::move_to_uci(move);
+            result += ";";
+        }
+        if (!record.id.empty()) result += " " + record.id + ";";
+        return result;
+    }
+
+    // the reader hands out numbered lines, the workers return the results in any order
+    // and the results are written as soon as all the lines before them are done
+    struct batch_state {
+        std::mutex mutex;
+        std::condition_variable input_available;
+        std::condition_variable output_written;
+        std::deque<std::pair<size_t, string>> input;
+        bool end_of_input = false;
+        std::map<size_t, string> finished;
+        size_t written = 0;
+
+        std::ostream *output;
+        U64 total_nodes = 0;
+        std::chrono::time_point<std::chrono::steady_clock> start_time;
+        std::chrono::time_point<std::chrono::steady_clock> last_report;
+    };
+
+    double seconds_since(std::chrono::time_point<std::chrono::steady_clock> start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report_progress(batch_state &state)
+    {
+        double seconds = seconds_since(state.start_time);
+        cerr << state.written << " positions in " << (int)seconds << " s, "
+             << (int)(state.written / std::max(seconds, 0.001)) << " positions/s, "
+             << (U64)(state.total_nodes / std::max(seconds, 0.001)) << " nodes/s" << endl;
+    }
+
+    void worker_loop(batch_state &state, const batch_options &options, search_limits limits)
+    {
+        EngineContext context(std::make_shared<TranspositionTable>(options.hash_mb));
+        while (true)
+        {
+            std::pair<size_t, string> item;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.input_available.wait(lock, [&state]() { return !state.input.empty() || state.end_of_input; });
+                if (state.input.empty()) return;
+                item = std::move(state.input.front());
+                state.input.pop_front();
+            }
+
+            U64 nodes = 0;
+            string result = analyse(context, item.second, limits, nodes);
+
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.total_nodes += nodes;
+            state.finished[item.first] = std::move(result);
+            auto next = state.finished.begin();
+            while (next != state.finished.end() && next->first == state.written)
+            {
+                *state.output << next->second << '\n';
+                next = state.finished.erase(next);
+                state.written++;
+            }
+            state.output_written.notify_one();
+
+            if (seconds_since(state.last_report) >= progress_interval)
+            {
+                state.last_report = std::chrono::steady_clock::now();
+                report_progress(state);
+            }
+        }
+    }
+
+    int run(const batch_options &options)
+    {
+        init_all();
+
+        std::ifstream input_file;
+        std::ofstream output_file;
+        if (!options.input_path.empty())
+        {
+            input_file.open(options.input_path);
+            if (!input_file)
+            {
+                cerr << "could not open " << options.input_path << endl;
+                return 1;
+            }
+        }
+        if (!options.output_path.empty())
+        {
+            output_file.open(options.output_path);
+            if (!output_file)
+            {
+                cerr << "could not create " << options.output_path << endl;
+                return 1;
+            }
+        }
+        std::istream &input = options.input_path.empty() ? std::cin : input_file;
+
+        search_limits limits;
+        limits.depth = options.depth;
+        limits.nodes = options.nodes;
+        if (limits.depth < 0 && limits.nodes < 0) limits.depth = default_depth;
+
+        batch_state state;
+        state.output = options.output_path.empty() ? &std::cout : &output_file;
+        state.start_time = state.last_report = std::chrono::steady_clock::now();
+
+        int threads = options.threads > 0 ? options.threads : std::max((int)std::thread::hardware_concurrency(), 1);
+        vector<std::thread> workers;
+        for (int i = 0; i < threads; i++) workers.emplace_back(worker_loop, std::ref(state), std::cref(options), limits);
+
+        // stream the input, reading ahead of the output only as far as the workers need
+        size_t pending_limit = (size_t)threads * pending_per_thread;
+        size_t count = 0;
+        string line;
+        while (std::getline(input, line))
+        {
+            if (trim(line).empty() || trim(line)[0] == '#') continue;
+            {
+                std::unique_lock<std::mutex> lock(state.mutex);
+                state.output_written.wait(lock, [&]() { return count - state.written < pending_limit; });
+                state.input.emplace_back(count++, std::move(line));
+            }
+            state.input_available.notify_one();
+        }
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.end_of_input = true;
+        }
+        state.input_available.notify_all();
+        for (std::thread &worker : workers) worker.join();
+
+        state.output->flush();
+        report_progress(state);
+        return 0;
+    }
+}
@@ -0,0 +1,292 @@
+#include "Tools/dataGenerator.h"
+#include "engineContext.h"
+#include "uci.h"
+#include "Engine/engine.h"
+#include "Engine/transpositionTable.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <span>
+#include <memory>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::array;
+using std::span;
+
+using board::move_capture;
+using board::move_promotion;
+using board_utils::pack_board;
+using board_utils::unpack_board;
+using move_generator::generate_moves;
+using move_generator::find_attack_info;
+using move_generator::attack_info;
+using piece_attacks::init_all;
+using transposition_table::TranspositionTable;
+using namespace constants;
+
+
+namespace data_generator
+{
+    const size_t records_per_buffer = 8192;  // 256 kB handed to a writer at a time
+    const size_t max_queued_buffers = 64;  // per shard, only a disk slower than all searches together fills this
+    const int max_game_plies = 400;  // adjudicated as a draw
+    const int decisive_score = 1000;  // both sides agreeing for decisive_plies ends the game
+    const int decisive_plies = 8;
+    const int progress_interval = 10;  // seconds
+
+    training_record pack_record(const board_state &board, int score, int result)
+    {
+        training_record record = {};
+        record.position = pack_board(board);
+        record.score = std::clamp(score, -32767, 32767);
+        record.fullmove_number = std::min(board.fullmove_number, 65535);
+        record.halfmove_clock = std::min(board.halfmove_clock, 255);
+        record.result = result;
+        return record;
+    }
+
+    board_state unpack_record(const training_record &record)
+    {
+        return unpack_board(record.position, record.halfmove_clock, record.fullmove_number);
+    }
+
+    // one output file, written by a thread of its own from a queue of full buffers
+    class ShardWriter {
+        public:
+            ShardWriter(const string &path) : file(std::fopen(path.c_str(), "wb")), writer(&ShardWriter::write_loop, this) {}
+            ~ShardWriter() { close(); }
+
+            bool is_open() const { return file != nullptr; }
+            bool failed() const { return write_failed; }  // the buffers after a failed write are dropped
+
+            // writes what is queued and closes the file, false if any of it was not written
+            bool close()
+            {
+                if (writer.joinable())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        closing = true;
+                    }
+                    changed.notify_all();
+                    writer.join();
+                }
+                if (file != nullptr && std::fclose(file) != 0) write_failed = true;
+                file = nullptr;
+                return !write_failed;
+            }
+
+            // hands over a full buffer and returns an empty one
+            vector<training_record> submit(vector<training_record> &&records)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]() { return queue.size() < max_queued_buffers; });
+                queue.push_back(std::move(records));
+                vector<training_record> empty;
+                if (!spare.empty())
+                {
+                    empty = std::move(spare.back());
+                    spare.pop_back();
+                }
+                lock.unlock();
+                changed.notify_all();
+                empty.clear();
+                empty.reserve(records_per_buffer);
+                return empty;
+            }
+
+        private:
+            void write_loop()
+            {
+                while (true)
+                {
+                    vector<training_record> records;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [this]() { return closing || !queue.empty(); });
+                        if (queue.empty()) return;
+                        records = std::move(queue.front());
+                        queue.pop_front();
+                    }
+                    changed.notify_all();
+                    if (file != nullptr && !write_failed && std::fwrite(records.data(), sizeof(training_record), records.size(), file) != records.size()) write_failed = true;
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    spare.push_back(std::move(records));
+                }
+            }
+
+            std::FILE *file;
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<vector<training_record>> queue;
+            vector<vector<training_record>> spare;  // written buffers, reused to avoid allocations
+            bool closing = false;
+            std::atomic<bool> write_failed = false;
+            std::thread writer;  // last, it starts in the constructor
+    };
+
+    bool insufficient_material(const board_state &board)
+    {
+        U64 heavy = board.bitboards[P] | board.bitboards[p] | board.bitboards[R] | board.bitboards[r] | board.bitboards[Q] | board.bitboards[q];
+        U64 minor = board.bitboards[N] | board.bitboards[n] | board.bitboards[B] | board.bitboards[b];
+        return heavy == 0 && (minor & (minor - 1)) == 0;
+    }
+
+    struct generator_state {
+        const generator_options &options;
+        vector<std::unique_ptr<ShardWriter>> &shards;
+        std::atomic<U64> positions = 0;
+        std::atomic<U64> games = 0;
+        std::atomic<bool> failed = false;  // a shard could not be written, the workers stop
+    };
+
+    void play_games(generator_state &state, int thread)
+    {
+        const generator_options &options = state.options;
+        EngineContext context(std::make_shared<TranspositionTable>(options.hash_mb));
+        Engine &engine = context.engine();
+        std::mt19937_64 random(options.seed * 1000003 + thread);
+        ShardWriter &shard = *state.shards[thread % state.shards.size()];
+        vector<training_record> buffer;
+        buffer.reserve(records_per_buffer);
+        vector<training_record> game_records;
+        vector<U64> history;  // of the played positions, for threefold repetitions
+
+        search_limits limits;
+        limits.nodes = options.nodes;
+        array<unsigned int, max_moves> move_list;
+
+        while (state.positions < options.positions && !state.failed)
+        {
+            context.set_position("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+            game_records.clear();
+            history.clear();
+
+            // random openings, the game is thrown away if it ends in them
+            bool playable = true;
+            for (int ply = 0; ply < options.random_plies && playable; ply++)
+            {
+                span<unsigned int> moves = generate_moves(context.position(), move_list, false);
+                if (moves.empty()) playable = false;
+                else context.play_move(uci::move_to_uci(moves[random() % moves.size()]));
+            }
+            if (!playable || generate_moves(context.position(), move_list, false).empty()) continue;
+
+            int result = 1;
+            int decisive_count = 0;
+            for (int ply = 0;; ply++)
+            {
+                board_state &board = context.position();
+                int score = engine.iterative_search(board, limits);
+                unsigned int move = engine.best_move();
+                if (move == 0) break;
+
+                // quiet positions only, the score of the others depends on the captures that follow
+                attack_info attack_map = find_attack_info(board);
+                bool quiet = !move_generator::in_check(board, attack_map) && move_capture(move) == no_piece && move_promotion(move) == no_promotion;
+                if (quiet && std::abs(score) < check_mate_score - 1000) game_records.push_back(pack_record(board, score, 0));
+
+                // counts up while white is winning and down while black is
+                int white_score = board.side == white ? score : -score;
+                if (white_score >= decisive_score) decisive_count = std::max(decisive_count, 0) + 1;
+                else if (white_score <= -decisive_score) decisive_count = std::min(decisive_count, 0) - 1;
+                else decisive_count = 0;
+                if (std::abs(decisive_count) >= decisive_plies)
+                {
+                    result = decisive_count > 0 ? 2 : 0;
+                    break;
+                }
+
+                int mover = board.side;
+                context.play_move(uci::move_to_uci(move));
+                board_state &next = context.position();
+                history.push_back(next.zobrist_hash);
+                if (generate_moves(next, move_list, false).empty())
+                {
+                    attack_info next_attacks = find_attack_info(next);
+                    if (move_generator::in_check(next, next_attacks)) result = mover == white ? 2 : 0;
+                    break;
+                }
+                if (next.halfmove_clock >= 100 || insufficient_material(next) || ply >= max_game_plies) break;
+                if (std::count(history.end() - std::min<int>(history.size(), next.halfmove_clock + 1), history.end(), next.zobrist_hash) >= 3) break;
+            }
+
+            for (training_record &record : game_records)
+            {
+                record.result = result;
+                buffer.push_back(record);
+                if (buffer.size() >= records_per_buffer) buffer = shard.submit(std::move(buffer));
+            }
+            state.positions += game_records.size();
+            state.games++;
+            if (shard.failed()) state.failed = true;
+        }
+        if (!buffer.empty()) shard.submit(std::move(buffer));
+    }
+
+    int run(const generator_options &options)
+    {
+        init_all();
+        int threads = options.threads > 0 ? options.threads : std::max((int)std::thread::hardware_concurrency(), 1);
+        int n_shards = options.shards > 0 ? options.shards : threads;
+
+        vector<std::unique_ptr<ShardWriter>> shards;
+        vector<string> paths;
+        for (int i = 0; i < n_shards; i++)
+        {
+            string path = options.output_prefix + "_" + std::to_string(i) + ".bin";
+            paths.push_back(path);
+            shards.push_back(std::make_unique<ShardWriter>(path));
+            if (!shards.back()->is_open())
+            {
+                cerr << "could not create " << path << endl;
+                return 1;
+            }
+        }
+
+        generator_state state{options, shards};
+        auto start_time = std::chrono::steady_clock::now();
+        vector<std::thread> workers;
+        for (int i = 0; i < threads; i++) workers.emplace_back(play_games, std::ref(state), i);
+
+        auto report = [&]() {
+            double seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count(), 0.001);
+            cerr << state.games << " games, " << state.positions << " positions in " << (int)seconds << " s, "
+                 << (U64)(state.positions / seconds) << " positions/s" << endl;
+        };
+        while (state.positions < options.positions && !state.failed)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_time).count() % progress_interval == 0) report();
+        }
+        for (std::thread &worker : workers) worker.join();
+
+        // the writers finish their queues
+        bool written = true;
+        for (int i = 0; i < n_shards; i++)
+        {
+            if (shards[i]->close()) continue;
+            cerr << "could not write " << paths[i] << ", the records after the failed write are lost" << endl;
+            written = false;
+        }
+        report();
+        return written ? 0 : 1;
+    }
+}
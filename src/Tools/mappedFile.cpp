@@ -0,0 +1,51 @@
+#include "Tools/mappedFile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string &path, bool sequential)
+{
+    close();
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat status;
+    if (fstat(file, &status) < 0)
+    {
+        ::close(file);
+        return false;
+    }
+    length = status.st_size;
+    if (length == 0)
+    {
+        // an empty file can not be mapped, but it is a valid file without contents
+        ::close(file);
+        return true;
+    }
+
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);  // the mapping keeps the file open
+    if (address == MAP_FAILED)
+    {
+        length = 0;
+        return false;
+    }
+    mapping = static_cast<char *>(address);
+    madvise(mapping, length, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapping != nullptr) munmap(mapping, length);
+    mapping = nullptr;
+    length = 0;
+}
@@ -0,0 +1,508 @@
+#include "Tools/matchRunner.h"
+#include "Tools/pgnReader.h"
+#include "uci.h"
+#include "Board/board.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::array;
+using std::span;
+
+using board::board_state;
+using board::make_move;
+using board_utils::parse_fen;
+using move_generator::generate_moves;
+using piece_attacks::init_all;
+using bitboard_utils::count_bits;
+using namespace constants;
+
+
+namespace match_runner
+{
+    const string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    const int startup_milli_seconds = 10000;  // for uciok, readyok and the bestmove after a stop
+    const int adjudicated_mate_score = 100000;
+
+    // an engine running as a child process, spoken to over pipes
+    class UciProcess {
+        public:
+            ~UciProcess() { stop(); }
+
+            bool start(const string &command)
+            {
+                int to_child[2], from_child[2];
+                if (pipe(to_child) < 0) return false;
+                if (pipe(from_child) < 0)
+                {
+                    ::close(to_child[0]);
+                    ::close(to_child[1]);
+                    return false;
+                }
+                // engines started by the other game threads must not inherit these pipes
+                for (int descriptor : {to_child[0], to_child[1], from_child[0], from_child[1]}) fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+
+                // the child may only call async signal safe functions, so the command is prepared before
+                string shell_command = "exec " + command;
+                pid = fork();
+                if (pid == 0)
+                {
+                    dup2(to_child[0], STDIN_FILENO);
+                    dup2(from_child[1], STDOUT_FILENO);
+                    execl("/bin/sh", "sh", "-c", shell_command.c_str(), (char *)nullptr);
+                    _exit(127);
+                }
+                ::close(to_child[0]);
+                ::close(from_child[1]);
+                input = to_child[1];
+                output = from_child[0];
+                buffer.clear();
+                return pid > 0;
+            }
+
+            void stop()
+            {
+                if (pid <= 0) return;
+                send("quit");
+                ::close(input);
+                ::close(output);
+
+                // give the engine a moment to quit by itself
+                for (int i = 0; i < 50 && waitpid(pid, nullptr, WNOHANG) == 0; i++) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                if (waitpid(pid, nullptr, WNOHANG) == 0)
+                {
+                    kill(pid, SIGKILL);
+                    waitpid(pid, nullptr, 0);
+                }
+                pid = -1;
+            }
+
+            bool send(const string &line)
+            {
+                string data = line + "\n";
+                size_t sent = 0;
+                while (sent < data.size())
+                {
+                    ssize_t result = write(input, data.data() + sent, data.size() - sent);
+                    if (result <= 0) return false;
+                    sent += result;
+                }
+                return true;
+            }
+
+            bool read_line(string &line, int timeout_milli_seconds)
+            {
+                // false when the time is up or the engine has exited
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_milli_seconds);
+                while (true)
+                {
+                    size_t end = buffer.find('\n');
+                    if (end != string::npos)
+                    {
+                        line = buffer.substr(0, end);
+                        if (!line.empty() && line.back() == '\r') line.pop_back();
+                        buffer.erase(0, end + 1);
+                        return true;
+                    }
+
+                    int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                    if (left <= 0) return false;
+                    pollfd descriptor = {output, POLLIN, 0};
+                    if (poll(&descriptor, 1, left) <= 0) continue;
+
+                    char chunk[4096];
+                    ssize_t received = read(output, chunk, sizeof(chunk));
+                    if (received <= 0) return false;
+                    buffer.append(chunk, received);
+                }
+            }
+
+            bool wait_for(const string &expected, int timeout_milli_seconds)
+            {
+                string line;
+                while (read_line(line, timeout_milli_seconds))
+                {
+                    if (line.rfind(expected, 0) == 0) return true;
+                }
+                return false;
+            }
+
+            bool running() const { return pid > 0; }
+
+        private:
+            pid_t pid = -1;
+            int input = -1;
+            int output = -1;
+            string buffer;
+    };
+
+    bool start_engine(UciProcess &process, const engine_options &engine)
+    {
+        if (!process.start(engine.command)) return false;
+        process.send("uci");
+        if (!process.wait_for("uciok", startup_milli_seconds)) return false;
+        for (const auto &[name, value] : engine.options) process.send("setoption name " + name + " value " + value);
+        process.send("isready");
+        return process.wait_for("readyok", startup_milli_seconds);
+    }
+
+    enum game_outcome {white_wins, black_wins, draw};
+
+    struct played_game {
+        string opening;
+        vector<string> san_moves;
+        game_outcome outcome = draw;
+        string termination;
+        bool first_engine_white = true;
+    };
+
+    bool insufficient_material(board_state &board)
+    {
+        // no pawns, rooks or queens and at most one minor piece
+        U64 heavy = board.bitboards[P] | board.bitboards[p] | board.bitboards[R] | board.bitboards[r] | board.bitboards[Q] | board.bitboards[q];
+        U64 minor = board.bitboards[N] | board.bitboards[n] | board.bitboards[B] | board.bitboards[b];
+        return heavy == 0 && count_bits(minor) <= 1;
+    }
+
+    int parse_score(const string &line, int previous)
+    {
+        // the score in an info line, from the view of the engine to move
+        std::istringstream stream(line);
+        string token;
+        while (stream >> token)
+        {
+            if (token != "score") continue;
+            string kind;
+            int value;
+            if (!(stream >> kind >> value)) return previous;
+            if (kind == "cp") return value;
+            if (kind == "mate") return value > 0 ? adjudicated_mate_score : -adjudicated_mate_score;
+        }
+        return previous;
+    }
+
+    // plays one game, the engines are restarted if they crash or lose their way
+    played_game play_game(const match_options &options, array<UciProcess, 2> &engines, const string &opening, bool first_engine_white)
+    {
+        played_game game;
+        game.opening = opening;
+        game.first_engine_white = first_engine_white;
+
+        board_state board = parse_fen(opening);
+        vector<U64> history = {board.zobrist_hash};
+        string moves;
+        array<long long, 2> clock = {options.base_milli_seconds, options.base_milli_seconds};
+        array<int, 2> scores = {0, 0};  // the last score of each side, from the view of white
+        int resign_count = 0, draw_count = 0;
+
+        for (UciProcess &engine : engines)
+        {
+            engine.send("ucinewgame");
+            engine.send("isready");
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (!engines[i].wait_for("readyok", startup_milli_seconds))
+            {
+                // an engine which does not answer loses the game
+                bool white_failed = (i == 0) == first_engine_white;
+                game.outcome = white_failed ? black_wins : white_wins;
+                game.termination = "engine not responding";
+                engines[i].stop();
+                return game;
+            }
+        }
+
+        auto end_game = [&](game_outcome outcome, const string &termination) {
+            game.outcome = outcome;
+            game.termination = termination;
+            return game;
+        };
+
+        for (int ply = 0;; ply++)
+        {
+            int side = board.side;
+            UciProcess &engine = engines[(side == white) == first_engine_white ? 0 : 1];
+            game_outcome side_loses = side == white ? black_wins : white_wins;
+
+            engine.send("position fen " + opening + (moves.empty() ? "" : " moves" + moves));
+            engine.send("go wtime " + std::to_string(std::max(clock[white], 1LL)) + " btime " + std::to_string(std::max(clock[black], 1LL))
+                        + " winc " + std::to_string(options.increment_milli_seconds) + " binc " + std::to_string(options.increment_milli_seconds));
+            auto start = std::chrono::steady_clock::now();
+
+            string line, best_move;
+            int score = scores[side] * (side == white ? 1 : -1);
+            while (engine.read_line(line, clock[side] + options.time_margin_milli_seconds))
+            {
+                if (line.rfind("info", 0) == 0) score = parse_score(line, score);
+                else if (line.rfind("bestmove", 0) == 0)
+                {
+                    std::istringstream stream(line.substr(8));
+                    stream >> best_move;
+                    break;
+                }
+            }
+            long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            clock[side] -= elapsed;
+
+            if (best_move.empty())
+            {
+                // lost on time or crashed, a process which does not give its move after a stop is restarted
+                engine.send("stop");
+                if (!engine.wait_for("bestmove", startup_milli_seconds)) engine.stop();
+                return end_game(side_loses, clock[side] < -options.time_margin_milli_seconds ? "time forfeit" : "engine crashed");
+            }
+            if (clock[side] < -options.time_margin_milli_seconds) return end_game(side_loses, "time forfeit");
+            clock[side] += options.increment_milli_seconds;
+
+            unsigned int move = uci::parse_move(board, best_move);
+            if (move == 0) return end_game(side_loses, "illegal move " + best_move);
+            game.san_moves.push_back(pgn_reader::move_to_san(board, move));
+            board = make_move(board, move);
+            moves += " " + best_move;
+            history.push_back(board.zobrist_hash);
+
+            // the game rules first, then the adjudication
+            array<unsigned int, max_moves> move_list;
+            if (generate_moves(board, move_list, false).empty())
+            {
+                move_generator::attack_info attack_map = move_generator::find_attack_info(board);
+                if (move_generator::in_check(board, attack_map)) return end_game(side == white ? white_wins : black_wins, "checkmate");
+                return end_game(draw, "stalemate");
+            }
+            if (board.halfmove_clock >= 100) return end_game(draw, "fifty move rule");
+            if (std::count(history.begin(), history.end(), board.zobrist_hash) >= 3) return end_game(draw, "threefold repetition");
+            if (insufficient_material(board)) return end_game(draw, "insufficient material");
+
+            scores[side] = side == white ? score : -score;
+            if (scores[white] >= options.resign_score && scores[black] >= options.resign_score) resign_count = std::max(resign_count, 0) + 1;
+            else if (scores[white] <= -options.resign_score && scores[black] <= -options.resign_score) resign_count = std::min(resign_count, 0) - 1;
+            else resign_count = 0;
+            if (std::abs(resign_count) >= 2 * options.resign_moves) return end_game(resign_count > 0 ? white_wins : black_wins, "adjudication");
+
+            bool drawish = std::abs(scores[white]) <= options.draw_score && std::abs(scores[black]) <= options.draw_score;
+            draw_count = drawish && ply >= 2 * options.draw_start ? draw_count + 1 : 0;
+            if (draw_count >= 2 * options.draw_moves) return end_game(draw, "adjudication");
+        }
+    }
+
+    double score_to_elo(double score)
+    {
+        return -400 * std::log10(1 / score - 1);
+    }
+
+    double score_of(const match_result &result, double &variance)
+    {
+        // the mean score per game and its variance per game
+        double n = result.wins + result.draws + result.losses;
+        double score = (result.wins + 0.5 * result.draws) / n;
+        variance = (result.wins * std::pow(1 - score, 2) + result.draws * std::pow(0.5 - score, 2) + result.losses * std::pow(score, 2)) / n;
+        return score;
+    }
+
+    elo_estimate estimate_elo(const match_result &result)
+    {
+        int n = result.wins + result.draws + result.losses;
+        if (n == 0) return {0, INFINITY};
+        double variance;
+        double score = score_of(result, variance);
+        if (variance == 0) return {score_to_elo(std::clamp(score, 1e-6, 1 - 1e-6)), INFINITY};  // all games ended alike
+        double margin = 1.959964 * std::sqrt(variance / n);
+        double low = std::clamp(score - margin, 1e-6, 1 - 1e-6), high = std::clamp(score + margin, 1e-6, 1 - 1e-6);
+        double elo = score_to_elo(std::clamp(score, 1e-6, 1 - 1e-6));
+        return {elo, (score_to_elo(high) - score_to_elo(low)) / 2};
+    }
+
+    double log_likelihood_ratio(const match_result &result, double elo0, double elo1)
+    {
+        // normal approximation of the trinomial test, as used by the common testing frameworks
+        int n = result.wins + result.draws + result.losses;
+        if (n == 0) return 0;
+        double variance;
+        double score = score_of(result, variance);
+        if (variance == 0) return 0;  // all games ended alike, there is nothing to tell them apart yet
+        double score0 = 1 / (1 + std::pow(10, -elo0 / 400)), score1 = 1 / (1 + std::pow(10, -elo1 / 400));
+        return n * (score1 - score0) * (2 * score - score0 - score1) / (2 * variance);
+    }
+
+    vector<string> read_openings(const string &path, bool &ok)
+    {
+        // the first four fields of every line, the clocks start anew
+        vector<string> openings;
+        ok = true;
+        if (path.empty()) return {start_position};
+        std::ifstream input(path);
+        if (!input)
+        {
+            ok = false;
+            return openings;
+        }
+        string line;
+        int line_number = 0;
+        while (std::getline(input, line))
+        {
+            line_number++;
+            std::istringstream stream(line);
+            array<string, 4> fields;
+            if (!(stream >> fields[0] >> fields[1] >> fields[2] >> fields[3]) || fields[0][0] == '#') continue;
+            string fen = fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3] + " 0 1";
+
+            // the games are replayed from the opening, so an invalid one could not be played at all
+            board_state board;
+            board_utils::fen_error error = parse_fen(fen, board);
+            if (error != board_utils::fen_error::none)
+            {
+                cerr << path << ":" << line_number << " skipped, " << board_utils::fen_error_text(error) << endl;
+                continue;
+            }
+            openings.push_back(fen);
+        }
+        ok = !openings.empty();
+        return openings;
+    }
+
+    string engine_name(const engine_options &engine, int index)
+    {
+        return "engine " + std::to_string(index + 1) + " (" + engine.command + ")";
+    }
+
+    void write_pgn(std::ofstream &pgn, const played_game &game, int round, const array<string, 2> &names)
+    {
+        static const array<string, 3> results = {"1-0", "0-1", "1/2-1/2"};
+        string result = results[game.outcome];
+        pgn << "[Event \"match\"]\n[Site \"?\"]\n[Round \"" << round << "\"]\n"
+            << "[White \"" << names[game.first_engine_white ? 0 : 1] << "\"]\n[Black \"" << names[game.first_engine_white ? 1 : 0] << "\"]\n"
+            << "[Result \"" << result << "\"]\n";
+        if (game.opening != start_position) pgn << "[FEN \"" << game.opening << "\"]\n[SetUp \"1\"]\n";
+        pgn << "[Termination \"" << game.termination << "\"]\n\n";
+
+        board_state board = parse_fen(game.opening);
+        int column = 0;
+        for (size_t i = 0; i < game.san_moves.size(); i++)
+        {
+            string text;
+            if (i == 0 && board.side == black) text = std::to_string(board.fullmove_number) + "... ";
+            else if ((i + (board.side == black)) % 2 == 0) text = std::to_string(board.fullmove_number + (i + (board.side == black)) / 2) + ". ";
+            text += game.san_moves[i];
+            if (column + text.size() > 79)
+            {
+                pgn << "\n";
+                column = 0;
+            }
+            pgn << (column > 0 ? " " : "") << text;
+            column += text.size() + 1;
+        }
+        pgn << (column > 0 ? " " : "") << result << "\n\n";
+    }
+
+    void print_result(const match_result &result, const match_options &options)
+    {
+        elo_estimate elo = estimate_elo(result);
+        int n = result.wins + result.draws + result.losses;
+        cout << "games " << n << ": " << result.wins << " wins, " << result.draws << " draws, " << result.losses << " losses, "
+             << "elo " << std::round(elo.elo * 10) / 10 << " +/- " << std::round(elo.error * 10) / 10;
+        if (options.sprt)
+        {
+            cout << ", llr " << std::round(log_likelihood_ratio(result, options.elo0, options.elo1) * 100) / 100
+                 << " (" << std::round(std::log(options.beta / (1 - options.alpha)) * 100) / 100
+                 << ", " << std::round(std::log((1 - options.beta) / options.alpha) * 100) / 100 << ")";
+        }
+        cout << endl;
+    }
+
+    int run(const match_options &options)
+    {
+        std::signal(SIGPIPE, SIG_IGN);  // a crashing engine must not end the match
+        init_all();
+
+        bool ok;
+        vector<string> openings = read_openings(options.openings_path, ok);
+        if (!ok)
+        {
+            cerr << "no openings in " << options.openings_path << endl;
+            return 1;
+        }
+        std::ofstream pgn;
+        if (!options.pgn_path.empty()) pgn.open(options.pgn_path, std::ios::app);
+
+        array<string, 2> names = {engine_name(options.engines[0], 0), engine_name(options.engines[1], 1)};
+        double lower_bound = std::log(options.beta / (1 - options.alpha)), upper_bound = std::log((1 - options.beta) / options.alpha);
+
+        std::mutex mutex;
+        match_result result;
+        std::atomic<int> next_game = 0;
+        std::atomic<bool> finished = false;
+        string verdict;
+
+        auto play_games = [&]() {
+            array<UciProcess, 2> engines;
+            int game_index;
+            while (!finished && (game_index = next_game++) < options.games)
+            {
+                for (int i = 0; i < 2; i++)
+                {
+                    if (engines[i].running()) continue;
+                    if (!start_engine(engines[i], options.engines[i]))
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        cerr << "could not start " << names[i] << endl;
+                        finished = true;
+                        return;
+                    }
+                }
+
+                // every opening is played with both colours by both engines
+                const string &opening = openings[(game_index / 2) % openings.size()];
+                played_game game = play_game(options, engines, opening, game_index % 2 == 0);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (game.outcome == draw) result.draws++;
+                else if ((game.outcome == white_wins) == game.first_engine_white) result.wins++;
+                else result.losses++;
+                if (pgn.is_open()) write_pgn(pgn, game, game_index + 1, names);
+                print_result(result, options);
+
+                double llr = log_likelihood_ratio(result, options.elo0, options.elo1);
+                if (options.sprt && verdict.empty() && (llr <= lower_bound || llr >= upper_bound))
+                {
+                    verdict = llr >= upper_bound ? "H1 accepted, the first engine is at least " + std::to_string((int)options.elo1) + " elo stronger"
+                                                 : "H0 accepted, the first engine is not " + std::to_string((int)options.elo1) + " elo stronger";
+                    finished = true;
+                }
+            }
+        };
+
+        vector<std::thread> threads;
+        for (int i = 0; i < std::max(options.concurrency, 1); i++) threads.emplace_back(play_games);
+        for (std::thread &thread : threads) thread.join();
+
+        cout << "finished: ";
+        print_result(result, options);
+        if (options.sprt) cout << "sprt: " << (verdict.empty() ? "no decision" : verdict) << endl;
+        return 0;
+    }
+}
@@ -0,0 +1,338 @@
+#include "Tools/openingBook.h"
+#include "Tools/pgnReader.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::array;
+
+using move_generator::generate_moves;
+using piece_attacks::init_all;
+using namespace constants;
+
+
+namespace opening_book
+{
+    const int n_shards = 64;
+    const size_t bytes_per_statistic = 96;  // a hash map node with its key and statistics, roughly
+    const size_t buffered_updates = 4096;  // per thread, so that a shard is locked once for many updates
+
+    struct move_key {
+        U64 key;
+        uint32_t move;
+        bool operator==(const move_key &other) const { return key == other.key && move == other.move; }
+    };
+
+    struct move_key_hash {
+        size_t operator()(const move_key &key) const { return key.key ^ (key.move * 0x9e3779b97f4a7c15ULL); }
+    };
+
+    struct move_statistics {
+        uint32_t games = 0;
+        uint32_t wins = 0;
+        uint32_t draws = 0;
+    };
+
+    struct update {
+        move_key key;
+        int result;  // 1 for a win of the side playing the move, 0 for a draw, -1 for a loss
+    };
+
+    bool entry_before(const book_entry &a, const book_entry &b)
+    {
+        return a.key != b.key ? a.key < b.key : a.move < b.move;
+    }
+
+    // the statistics of all threads, split by zobrist key into shards with a lock each.
+    // beyond the memory limit the statistics are sorted and written to a run file and the
+    // runs are merged at the end, positions in several runs are added up then
+    class ShardedStatistics {
+        public:
+            ShardedStatistics(size_t max_statistics, const string &run_prefix) : max_statistics(max_statistics), run_prefix(run_prefix) {}
+
+            void add(vector<update> &updates)
+            {
+                std::sort(updates.begin(), updates.end(), [](const update &a, const update &b) { return a.key.key % n_shards < b.key.key % n_shards; });
+                for (size_t start = 0; start < updates.size();)
+                {
+                    int shard_index = updates[start].key.key % n_shards;
+                    std::lock_guard<std::mutex> lock(shards[shard_index].mutex);
+                    auto &statistics = shards[shard_index].statistics;
+                    size_t size_before = statistics.size();
+                    for (; start < updates.size() && (int)(updates[start].key.key % n_shards) == shard_index; start++)
+                    {
+                        move_statistics &entry = statistics[updates[start].key];
+                        entry.games++;
+                        if (updates[start].result > 0) entry.wins++;
+                        if (updates[start].result == 0) entry.draws++;
+                    }
+
+                    // counted under the lock of the shard, so a spill never subtracts entries that are not counted yet
+                    in_memory += statistics.size() - size_before;
+                }
+                updates.clear();
+                if (in_memory > max_statistics) spill();
+            }
+
+            bool spill()
+            {
+                // one thread spills while the others keep adding to the shards already emptied
+                std::lock_guard<std::mutex> spill_lock(spill_mutex);
+                if (in_memory <= max_statistics && !finishing) return true;
+
+                vector<book_entry> run;
+                for (shard &current : shards)
+                {
+                    std::lock_guard<std::mutex> lock(current.mutex);
+                    for (const auto &[key, statistics] : current.statistics) run.push_back({key.key, key.move, statistics.games, statistics.wins, statistics.draws});
+                    in_memory -= current.statistics.size();
+                    current.statistics = {};  // frees the buckets as well
+                }
+                if (run.empty()) return true;
+                std::sort(run.begin(), run.end(), entry_before);
+
+                string path = run_prefix + std::to_string(run_paths.size());
+                std::ofstream output(path, std::ios::binary);
+                output.write(reinterpret_cast<const char *>(run.data()), run.size() * sizeof(book_entry));
+                if (!output)
+                {
+                    failed = true;
+                    return false;
+                }
+                run_paths.push_back(path);
+                return true;
+            }
+
+            vector<string> finish()
+            {
+                finishing = true;
+                spill();
+                return run_paths;
+            }
+
+            std::atomic<bool> failed = false;
+
+        private:
+            struct shard {
+                std::mutex mutex;
+                std::unordered_map<move_key, move_statistics, move_key_hash> statistics;
+            };
+
+            array<shard, n_shards> shards;
+            std::atomic<size_t> in_memory = 0;
+            size_t max_statistics;
+            string run_prefix;
+            std::mutex spill_mutex;
+            vector<string> run_paths;
+            bool finishing = false;
+    };
+
+    struct run_reader {
+        std::ifstream input;
+        book_entry current;
+
+        bool next() { return (bool)input.read(reinterpret_cast<char *>(&current), sizeof(book_entry)); }
+    };
+
+    bool keep_entry(const book_entry &entry, const build_options &options)
+    {
+        if ((int)entry.games < options.min_games) return false;
+        double score = (entry.wins + 0.5 * entry.draws) / entry.games;
+        return score >= options.min_score;
+    }
+
+    U64 merge_runs(const vector<string> &run_paths, const build_options &options, bool &ok)
+    {
+        // k-way merge of the sorted runs, the same position and move in several runs are added up
+        vector<std::unique_ptr<run_reader>> readers;
+        auto later = [&readers](int a, int b) { return entry_before(readers[b]->current, readers[a]->current); };
+        std::priority_queue<int, vector<int>, decltype(later)> queue(later);
+        for (const string &path : run_paths)
+        {
+            readers.push_back(std::make_unique<run_reader>());
+            readers.back()->input.open(path, std::ios::binary);
+            if (readers.back()->next()) queue.push(readers.size() - 1);
+        }
+
+        std::ofstream output(options.output_path, std::ios::binary);
+        book_header header = {book_magic, 0};
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        vector<book_entry> buffer;
+        bool has_pending = false;
+        book_entry pending{};
+        auto emit = [&]() {
+            if (!has_pending || !keep_entry(pending, options)) return;
+            buffer.push_back(pending);
+            header.n_entries++;
+            if (buffer.size() >= buffered_updates)
+            {
+                output.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(book_entry));
+                buffer.clear();
+            }
+        };
+
+        while (!queue.empty())
+        {
+            int index = queue.top();
+            queue.pop();
+            const book_entry &entry = readers[index]->current;
+            if (has_pending && pending.key == entry.key && pending.move == entry.move)
+            {
+                pending.games += entry.games;
+                pending.wins += entry.wins;
+                pending.draws += entry.draws;
+            }
+            else
+            {
+                emit();
+                pending = entry;
+                has_pending = true;
+            }
+            if (readers[index]->next()) queue.push(index);
+        }
+        emit();
+        output.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(book_entry));
+
+        // the number of entries is known only now
+        output.seekp(0);
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ok = (bool)output;
+        return header.n_entries;
+    }
+
+    int game_result(std::string_view result)
+    {
+        // from the view of white, 2 if the game has no result
+        if (result == "1-0") return 1;
+        if (result == "0-1") return -1;
+        if (result == "1/2-1/2") return 0;
+        return 2;
+    }
+
+    int build(const build_options &options)
+    {
+        init_all();
+        int threads = options.threads > 0 ? options.threads : std::max((int)std::thread::hardware_concurrency(), 1);
+        size_t max_statistics = std::max<size_t>(options.memory_mb * (1 << 20) / bytes_per_statistic, 1024);
+        ShardedStatistics statistics(max_statistics, options.output_path + ".run");
+
+        vector<vector<update>> thread_updates(threads);
+        U64 games = 0, positions = 0, skipped = 0;
+        for (const string &path : options.input_paths)
+        {
+            pgn_reader::read_statistics read;
+            bool opened = pgn_reader::read_file(path, threads, [&](const pgn_reader::pgn_game &game, int thread) {
+                int result = game_result(game.result);
+                if (result == 2) return;  // unfinished games say nothing about the moves
+                vector<update> &updates = thread_updates[thread];
+                for (size_t ply = 0; ply < game.moves.size() && (int)ply < options.max_ply; ply++)
+                {
+                    const board_state &board = game.positions[ply];
+                    updates.push_back({{board.zobrist_hash, game.moves[ply]}, board.side == white ? result : -result});
+                    if (updates.size() >= buffered_updates) statistics.add(updates);
+                }
+            }, read);
+            if (!opened)
+            {
+                cerr << "could not open " << path << endl;
+                return 1;
+            }
+            games += read.games;
+            positions += read.positions;
+            skipped += read.invalid_games;
+        }
+        for (vector<update> &updates : thread_updates) statistics.add(updates);
+
+        vector<string> run_paths = statistics.finish();
+        bool ok = !statistics.failed;
+        U64 n_entries = ok ? merge_runs(run_paths, options, ok) : 0;
+        for (const string &path : run_paths) std::remove(path.c_str());
+        if (!ok)
+        {
+            cerr << "could not write " << options.output_path << endl;
+            return 1;
+        }
+
+        cerr << games << " games (" << skipped << " not replayed completely), " << positions << " positions, "
+             << run_paths.size() << " runs, " << n_entries << " book entries" << endl;
+        return 0;
+    }
+
+    bool OpeningBook::open(const string &path)
+    {
+        entries = {};
+        if (!file.open(path, false) || file.size() < sizeof(book_header)) return false;
+        const book_header *header = reinterpret_cast<const book_header *>(file.data());
+        // compared by division, the multiplication with a corrupt count could overflow and match the size
+        size_t entries_size = file.size() - sizeof(book_header);
+        if (header->magic != book_magic || entries_size % sizeof(book_entry) != 0 || header->n_entries != entries_size / sizeof(book_entry)) return false;
+        entries = span<const book_entry>(reinterpret_cast<const book_entry *>(file.data() + sizeof(book_header)), header->n_entries);
+        return true;
+    }
+
+    span<const book_entry> OpeningBook::find(U64 key) const
+    {
+        auto first = std::lower_bound(entries.begin(), entries.end(), key, [](const book_entry &entry, U64 key) { return entry.key < key; });
+        auto last = first;
+        while (last != entries.end() && last->key == key) last++;
+        return span<const book_entry>(first, last);
+    }
+
+    vector<const book_entry *> OpeningBook::legal_entries(board_state &board, U64 &total_games) const
+    {
+        // only legal moves are returned, a different position with the same key may be in the book
+        array<unsigned int, max_moves> move_list;
+        span<unsigned int> legal_moves = generate_moves(board, move_list, false);
+        vector<const book_entry *> candidates;
+        total_games = 0;
+        for (const book_entry &entry : find(board.zobrist_hash))
+        {
+            if (std::find(legal_moves.begin(), legal_moves.end(), entry.move) == legal_moves.end()) continue;
+            candidates.push_back(&entry);
+            total_games += entry.games;
+        }
+        return candidates;
+    }
+
+    unsigned int OpeningBook::probe(board_state &board) const
+    {
+        U64 total_games;
+        vector<const book_entry *> candidates = legal_entries(board, total_games);
+        if (candidates.empty()) return 0;
+        return (*std::max_element(candidates.begin(), candidates.end(), [](const book_entry *a, const book_entry *b) { return a->games < b->games; }))->move;
+    }
+
+    unsigned int OpeningBook::probe(board_state &board, std::mt19937_64 &random) const
+    {
+        U64 total_games;
+        vector<const book_entry *> candidates = legal_entries(board, total_games);
+        if (candidates.empty() || total_games == 0) return 0;
+
+        // as often as the move was played
+        U64 choice = std::uniform_int_distribution<U64>(0, total_games - 1)(random);
+        for (const book_entry *entry : candidates)
+        {
+            if (choice < entry->games) return entry->move;
+            choice -= entry->games;
+        }
+        return candidates.back()->move;
+    }
+}
@@ -0,0 +1,405 @@
+#include "Tools/pgnReader.h"
+#include "Tools/mappedFile.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+#include "Board/board.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <span>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::array;
+using std::span;
+
+using board::make_move;
+using board::move_source;
+using board::move_target;
+using board::move_piece;
+using board::move_promotion;
+using board_utils::parse_fen;
+using move_generator::generate_moves;
+using piece_attacks::init_all;
+using namespace constants;
+
+
+namespace pgn_reader
+{
+    const string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+    const int chunks_per_thread = 16;  // more chunks than threads even out games of different lengths
+
+    string_view pgn_game::tag(string_view name) const
+    {
+        for (const std::pair<string_view, string_view> &tag : tags)
+        {
+            if (tag.first == name) return tag.second;
+        }
+        return string_view();
+    }
+
+    void pgn_game::clear()
+    {
+        tags.clear();
+        result = string_view();
+        moves.clear();
+        positions.clear();
+        error = nullptr;
+        offset = 0;
+    }
+
+    int san_piece_type(char character)
+    {
+        switch (character)
+        {
+            case 'N': return N;
+            case 'B': return B;
+            case 'R': return R;
+            case 'Q': return Q;
+            case 'K': return K;
+            default: return -1;
+        }
+    }
+
+    int san_promotion(char character)
+    {
+        switch (character)
+        {
+            case 'Q': case 'q': return promotion_queen;
+            case 'R': case 'r': return promotion_rook;
+            case 'B': case 'b': return promotion_bishop;
+            case 'N': case 'n': return promotion_knight;
+            default: return -1;
+        }
+    }
+
+    unsigned int parse_san(board_state &board, string_view san)
+    {
+        // check, mate and annotation symbols carry no information about the move
+        while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) san.remove_suffix(1);
+        if (san.size() < 2) return 0;
+
+        array<unsigned int, max_moves> move_list;
+        span<unsigned int> moves = generate_moves(board, move_list, false);
+
+        if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+        {
+            int king_target = (board.side == white ? g1 : g8) - (san.size() > 3 ? 4 : 0);
+            for (unsigned int move : moves)
+            {
+                if (move_piece(move) % 6 == K && board::move_castle(move) && move_target(move) == king_target) return move;
+            }
+            return 0;
+        }
+
+        int piece_type = san_piece_type(san[0]);
+        if (piece_type >= 0) san.remove_prefix(1);
+        else piece_type = P;
+
+        int promotion = no_promotion;
+        if (san.size() >= 2 && san_promotion(san.back()) >= 0 && piece_type == P)
+        {
+            promotion = san_promotion(san.back());
+            san.remove_suffix(1);
+            if (san.back() == '=') san.remove_suffix(1);
+        }
+
+        // the target square is last, before it an optional source file, rank and capture sign
+        if (san.size() < 2) return 0;
+        char target_file = san[san.size() - 2], target_rank = san[san.size() - 1];
+        if (target_file < 'a' || target_file > 'h' || target_rank < '1' || target_rank > '8') return 0;
+        int target = (8 - (target_rank - '0')) * 8 + (target_file - 'a');
+
+        int source_file = -1, source_rank = -1;
+        for (char character : san.substr(0, san.size() - 2))
+        {
+            if (character >= 'a' && character <= 'h') source_file = character - 'a';
+            else if (character >= '1' && character <= '8') source_rank = 8 - (character - '0');
+            else if (character != 'x' && character != ':' && character != '-') return 0;
+        }
+        if (piece_type == P && source_file < 0) source_file = target % 8;  // a pawn moving straight
+
+        unsigned int found = 0;
+        for (unsigned int move : moves)
+        {
+            if (move_target(move) != target || move_piece(move) % 6 != piece_type || move_promotion(move) != promotion) continue;
+            int source = move_source(move);
+            if (source_file >= 0 && source % 8 != source_file) continue;
+            if (source_rank >= 0 && source / 8 != source_rank) continue;
+            if (found != 0) return 0;  // ambiguous
+            found = move;
+        }
+        return found;
+    }
+
+    string move_to_san(board_state &board, unsigned int move)
+    {
+        int source = move_source(move), target = move_target(move), piece_type = move_piece(move) % 6;
+        string san;
+        if (board::move_castle(move)) san = target % 8 == 6 ? "O-O" : "O-O-O";
+        else
+        {
+            bool capture = board::move_capture(move) != no_piece || board::move_enpassant(move);
+            if (piece_type == P)
+            {
+                if (capture) san += (char)('a' + source % 8);
+            }
+            else
+            {
+                san += piece_to_string[piece_type];
+
+                // name the source file, or rank, if another piece of the same type can reach the target
+                array<unsigned int, max_moves> move_list;
+                bool same_file = false, same_rank = false, ambiguous = false;
+                for (unsigned int other : generate_moves(board, move_list, false))
+                {
+                    if (other == move || move_target(other) != target || move_piece(other) != move_piece(move)) continue;
+                    ambiguous = true;
+                    if (move_source(other) % 8 == source % 8) same_file = true;
+                    if (move_source(other) / 8 == source / 8) same_rank = true;
+                }
+                if (ambiguous && (!same_file || same_rank)) san += (char)('a' + source % 8);
+                if (ambiguous && same_file) san += (char)('8' - source / 8);
+            }
+            if (capture) san += 'x';
+            san += square_to_coordinates[target];
+            if (move_promotion(move) != no_promotion) san += string("=") + promotion_to_string[move_promotion(move)];
+        }
+
+        board_state next = make_move(board, move);
+        array<unsigned int, max_moves> move_list;
+        move_generator::attack_info attack_map = move_generator::find_attack_info(next);
+        if (move_generator::in_check(next, attack_map)) san += generate_moves(next, move_list, false).empty() ? "#" : "+";
+        return san;
+    }
+
+    bool is_space(char character)
+    {
+        return character == ' ' || character == '\n' || character == '\r' || character == '\t';
+    }
+
+    bool is_result(string_view token)
+    {
+        return token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*";
+    }
+
+    size_t skip_to(string_view text, size_t position, char end)
+    {
+        size_t found = text.find(end, position);
+        return found == string_view::npos ? text.size() : found + 1;
+    }
+
+    size_t read_tag(string_view text, size_t position, pgn_game &game)
+    {
+        // [Name "value"], the value may contain escaped quotes
+        size_t line_end = skip_to(text, position, '\n');
+        size_t name_start = position + 1;
+        size_t name_end = name_start;
+        while (name_end < line_end && !is_space(text[name_end]) && text[name_end] != '"' && text[name_end] != ']') name_end++;
+        size_t value_start = text.find('"', name_end);
+        if (value_start == string_view::npos || value_start >= line_end) return line_end;
+        value_start++;
+        size_t value_end = value_start;
+        while (value_end < line_end && text[value_end] != '"')
+        {
+            if (text[value_end] == '\\') value_end++;
+            value_end++;
+        }
+        if (value_end >= line_end) return line_end;
+        game.tags.emplace_back(text.substr(name_start, name_end - name_start), text.substr(value_start, value_end - value_start));
+        return line_end;
+    }
+
+    size_t read_game(string_view text, size_t position, pgn_game &game)
+    {
+        static const board_state start_board = parse_fen(start_position);
+        game.clear();
+        while (position < text.size() && is_space(text[position])) position++;
+        game.offset = position;
+
+        // the tag pairs, each on a line of its own
+        while (position < text.size())
+        {
+            while (position < text.size() && is_space(text[position])) position++;
+            if (position < text.size() && text[position] == '[') position = read_tag(text, position, game);
+            else break;
+        }
+
+        string_view fen = game.tag("FEN");
+        if (fen.empty()) game.positions.push_back(start_board);
+        else
+        {
+            board_state board;
+            if (parse_fen(fen, board) == board_utils::fen_error::none) game.positions.push_back(board);
+            else game.error = "invalid fen tag";
+        }
+
+        // the movetext ends with the termination marker, or where the tags of the next game begin
+        while (position < text.size())
+        {
+            char character = text[position];
+            if (is_space(character))
+            {
+                position++;
+                continue;
+            }
+            bool line_start = position == 0 || text[position - 1] == '\n';
+            if (character == '[' && line_start) break;
+            if (character == '%' && line_start)
+            {
+                position = skip_to(text, position, '\n');
+                continue;
+            }
+            if (character == '{')
+            {
+                position = skip_to(text, position, '}');
+                continue;
+            }
+            if (character == ';')
+            {
+                position = skip_to(text, position, '\n');
+                continue;
+            }
+            if (character == '(')
+            {
+                // variations may nest and contain comments
+                int depth = 0;
+                while (position < text.size())
+                {
+                    char current = text[position];
+                    if (current == '{') position = skip_to(text, position, '}') - 1;
+                    else if (current == '(') depth++;
+                    else if (current == ')' && --depth == 0) break;
+                    position++;
+                }
+                position++;
+                continue;
+            }
+            if (character == ')')
+            {
+                position++;
+                continue;
+            }
+
+            size_t token_end = position;
+            while (token_end < text.size() && !is_space(text[token_end]) && text[token_end] != '{' && text[token_end] != '(' && text[token_end] != ')' && text[token_end] != ';') token_end++;
+            string_view token = text.substr(position, token_end - position);
+            position = token_end;
+
+            if (is_result(token))
+            {
+                game.result = token;
+                break;
+            }
+            if (token[0] == '$') continue;  // numeric annotation glyph
+
+            // a move number, possibly written together with the move as in 12.e4 or 12...e5
+            size_t move_start = 0;
+            while (move_start < token.size() && token[move_start] >= '0' && token[move_start] <= '9') move_start++;
+            if (move_start > 0 && move_start < token.size() && token[move_start] != '.') move_start = 0;  // castling written with zeros
+            while (move_start < token.size() && token[move_start] == '.') move_start++;
+            token.remove_prefix(move_start);
+            if (token.empty() || game.error != nullptr) continue;
+
+            board_state &board = game.positions.back();
+            unsigned int move = parse_san(board, token);
+            if (move == 0)
+            {
+                game.error = "illegal or ambiguous move";
+                continue;
+            }
+            game.moves.push_back(move);
+            game.positions.push_back(make_move(board, move));
+        }
+        return position;
+    }
+
+    size_t next_game_start(string_view text, size_t position)
+    {
+        // a game starts with a tag line after an empty line, the tags of one game are not separated by empty lines
+        while (position < text.size())
+        {
+            size_t found = text.find("\n[", position);
+            if (found == string_view::npos) return text.size();
+            size_t line_start = found;
+            while (line_start > 0 && (text[line_start - 1] == '\r' || text[line_start - 1] == ' ' || text[line_start - 1] == '\t')) line_start--;
+            if (line_start > 0 && text[line_start - 1] == '\n') return found + 1;
+            position = found + 1;
+        }
+        return text.size();
+    }
+
+    read_statistics read_games(string_view text, int threads, const game_callback &callback)
+    {
+        init_all();
+        auto start_time = std::chrono::steady_clock::now();
+        threads = std::max(threads, 1);
+
+        // chunk boundaries are moved forward to the start of the next game
+        int n_chunks = text.size() < (1 << 20) ? 1 : threads * chunks_per_thread;
+        vector<size_t> boundaries = {0};
+        for (int i = 1; i < n_chunks; i++)
+        {
+            size_t boundary = std::max(next_game_start(text, text.size() / n_chunks * i), boundaries.back());
+            boundaries.push_back(boundary);
+        }
+        boundaries.push_back(text.size());
+
+        std::atomic<size_t> next_chunk = 0;
+        std::atomic<U64> games = 0, positions = 0, invalid_games = 0;
+        auto read_chunks = [&](int thread) {
+            pgn_game game;
+            U64 thread_games = 0, thread_positions = 0, thread_invalid_games = 0;
+            size_t chunk;
+            while ((chunk = next_chunk++) + 1 < boundaries.size())
+            {
+                size_t position = boundaries[chunk];
+                while (true)
+                {
+                    // a game belongs to the chunk in which its first tag starts
+                    while (position < text.size() && is_space(text[position])) position++;
+                    if (position >= boundaries[chunk + 1]) break;
+                    size_t game_start = position;
+                    position = read_game(text, position, game);
+                    if (position == game_start) position++;  // a stray character, never read a game twice
+                    
+                    thread_games++;
+                    thread_positions += game.positions.size();
+                    if (game.error != nullptr) thread_invalid_games++;
+                    callback(game, thread);
+                }
+            }
+            games += thread_games;
+            positions += thread_positions;
+            invalid_games += thread_invalid_games;
+        };
+
+        vector<std::thread> workers;
+        for (int i = 1; i < threads; i++) workers.emplace_back(read_chunks, i);
+        read_chunks(0);
+        for (std::thread &worker : workers) worker.join();
+
+        read_statistics statistics;
+        statistics.games = games;
+        statistics.positions = positions;
+        statistics.invalid_games = invalid_games;
+        statistics.bytes = text.size();
+        statistics.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        return statistics;
+    }
+
+    bool read_file(const string &path, int threads, const game_callback &callback, read_statistics &statistics)
+    {
+        MappedFile file;
+        if (!file.open(path)) return false;
+        statistics = read_games(file.contents(), threads, callback);
+        return true;
+    }
+}
@@ -0,0 +1,229 @@
+#include "Tools/positionIndex.h"
+#include "Tools/pgnReader.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::vector;
+
+using piece_attacks::init_all;
+
+
+namespace position_index
+{
+    const size_t buffered_entries = 4096;
+    const int max_files = 1 << 16;
+
+    bool entry_before(const index_entry &a, const index_entry &b)
+    {
+        if (a.key != b.key) return a.key < b.key;
+        return a.game != b.game ? a.game < b.game : a.ply < b.ply;
+    }
+
+    uint8_t game_result(string_view result)
+    {
+        if (result == "1-0") return 2;
+        if (result == "0-1") return 0;
+        if (result == "1/2-1/2") return 1;
+        return 3;
+    }
+
+    // merges sorted runs, the entries of the threads and the mapped old index, into a new index file
+    bool write_index(const string &path, const vector<span<const index_entry>> &runs, const vector<indexed_file> &files, U64 &n_entries)
+    {
+        vector<size_t> next(runs.size(), 0);
+        auto later = [&](int a, int b) { return entry_before(runs[b][next[b]], runs[a][next[a]]); };
+        std::priority_queue<int, vector<int>, decltype(later)> queue(later);
+        for (size_t i = 0; i < runs.size(); i++) if (!runs[i].empty()) queue.push(i);
+
+        std::ofstream output(path, std::ios::binary);
+        index_header header = {index_magic, 0, files.size(), 0};
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+        vector<index_entry> buffer;
+        while (!queue.empty())
+        {
+            int run = queue.top();
+            queue.pop();
+            buffer.push_back(runs[run][next[run]]);
+            if (++next[run] < runs[run].size()) queue.push(run);
+            if (buffer.size() >= buffered_entries)
+            {
+                output.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(index_entry));
+                header.n_entries += buffer.size();
+                buffer.clear();
+            }
+        }
+        output.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(index_entry));
+        header.n_entries += buffer.size();
+
+        // the file list: the indexed bytes, the length of the path and the path
+        header.files_offset = sizeof(index_header) + header.n_entries * sizeof(index_entry);
+        for (const indexed_file &file : files)
+        {
+            U64 length = file.path.size();
+            output.write(reinterpret_cast<const char *>(&file.indexed_bytes), sizeof(U64));
+            output.write(reinterpret_cast<const char *>(&length), sizeof(U64));
+            output.write(file.path.data(), length);
+        }
+
+        output.seekp(0);
+        output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        n_entries = header.n_entries;
+        return (bool)output;
+    }
+
+    int update(const index_options &options)
+    {
+        init_all();
+        int threads = options.threads > 0 ? options.threads : std::max((int)std::thread::hardware_concurrency(), 1);
+
+        PositionIndex old_index;
+        vector<indexed_file> files;
+        span<const index_entry> old_entries;
+        if (std::ifstream(options.index_path).good())
+        {
+            if (!old_index.open(options.index_path))
+            {
+                cerr << options.index_path << " is not a position index" << endl;
+                return 1;
+            }
+            files = old_index.files();
+            old_entries = old_index.all();
+        }
+
+        vector<vector<index_entry>> thread_entries(threads);
+        U64 games = 0, skipped = 0, bytes = 0;
+        for (const string &path : options.input_paths)
+        {
+            auto known = std::find_if(files.begin(), files.end(), [&path](const indexed_file &file) { return file.path == path; });
+            if (known == files.end())
+            {
+                if ((int)files.size() == max_files)
+                {
+                    cerr << "an index holds at most " << max_files << " files" << endl;
+                    return 1;
+                }
+                files.push_back({path, 0});
+                known = files.end() - 1;
+            }
+            U64 file_index = known - files.begin();
+
+            MappedFile pgn;
+            if (!pgn.open(path))
+            {
+                cerr << "could not open " << path << endl;
+                return 1;
+            }
+            if (pgn.size() < known->indexed_bytes)
+            {
+                cerr << path << " is shorter than when it was indexed, the index has to be built again" << endl;
+                return 1;
+            }
+
+            // only the games added since the last update
+            U64 start = known->indexed_bytes;
+            pgn_reader::read_statistics read = pgn_reader::read_games(pgn.contents().substr(start), threads, [&](const pgn_reader::pgn_game &game, int thread) {
+                vector<index_entry> &entries = thread_entries[thread];
+                U64 game_reference = (file_index << 48) | (start + game.offset);
+                uint8_t result = game_result(game.result);
+                for (size_t ply = 0; ply < game.positions.size() && ply <= 0xffff; ply++)
+                {
+                    if (options.max_ply > 0 && (int)ply > options.max_ply) break;
+                    unsigned int move = ply < game.moves.size() ? game.moves[ply] : 0;
+                    entries.push_back({game.positions[ply].zobrist_hash, game_reference, move, (uint16_t)ply, result, 0});
+                }
+            });
+            known->indexed_bytes = pgn.size();
+            games += read.games;
+            skipped += read.invalid_games;
+            bytes += read.bytes;
+        }
+
+        // every thread sorts its own entries, they are merged while writing
+        vector<std::thread> sorters;
+        for (vector<index_entry> &entries : thread_entries) sorters.emplace_back([&entries]() { std::sort(entries.begin(), entries.end(), entry_before); });
+        for (std::thread &sorter : sorters) sorter.join();
+
+        // the new index replaces the old one only when it is complete
+        string temporary_path = options.index_path + ".tmp";
+        vector<span<const index_entry>> runs(thread_entries.begin(), thread_entries.end());
+        runs.push_back(old_entries);
+        U64 n_entries = 0;
+        if (!write_index(temporary_path, runs, files, n_entries) || std::rename(temporary_path.c_str(), options.index_path.c_str()) != 0)
+        {
+            std::remove(temporary_path.c_str());
+            cerr << "could not write " << options.index_path << endl;
+            return 1;
+        }
+
+        cerr << games << " games added (" << skipped << " not replayed completely) from " << bytes << " bytes, "
+             << n_entries << " positions in the index" << endl;
+        return 0;
+    }
+
+    bool PositionIndex::open(const string &path)
+    {
+        entries = {};
+        file_list.clear();
+        if (!file.open(path, false) || file.size() < sizeof(index_header)) return false;
+        index_header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != index_magic || header.files_offset != sizeof(index_header) + header.n_entries * sizeof(index_entry) || header.files_offset > file.size()) return false;
+
+        size_t position = header.files_offset;
+        for (U64 i = 0; i < header.n_files; i++)
+        {
+            U64 indexed_bytes, length;
+            if (position + 2 * sizeof(U64) > file.size()) return false;
+            std::memcpy(&indexed_bytes, file.data() + position, sizeof(U64));
+            std::memcpy(&length, file.data() + position + sizeof(U64), sizeof(U64));
+            position += 2 * sizeof(U64);
+            if (length > file.size() - position) return false;
+            file_list.push_back({string(file.data() + position, length), indexed_bytes});
+            position += length;
+        }
+        entries = span<const index_entry>(reinterpret_cast<const index_entry *>(file.data() + sizeof(index_header)), header.n_entries);
+        return true;
+    }
+
+    span<const index_entry> PositionIndex::find(U64 key) const
+    {
+        if (entries.empty()) return {};
+
+        // the keys are spread evenly, so the position is guessed from the key and a window
+        // around the guess is widened until it contains the first entry of the key
+        size_t n = entries.size();
+        size_t guess = std::min((size_t)((double)key / 18446744073709551616.0 * n), n - 1);
+        size_t low = guess, high = guess + 1, step = 16;
+        while (low > 0 && entries[low].key >= key)
+        {
+            low = low > step ? low - step : 0;
+            step *= 2;
+        }
+        step = 16;
+        while (high < n && entries[high - 1].key < key)
+        {
+            high = std::min(high + step, n);
+            step *= 2;
+        }
+
+        auto first = std::lower_bound(entries.begin() + low, entries.begin() + high, key, [](const index_entry &entry, U64 key) { return entry.key < key; });
+        auto last = first;
+        while (last != entries.end() && last->key == key) last++;
+        return span<const index_entry>(first, last);
+    }
+}
@@ -0,0 +1,523 @@
+#include "Tools/texelTuner.h"
+#include "Tools/mappedFile.h"
+#include "Engine/engine.h"
+#include "Engine/defaultParameters.h"
+#include "Engine/transpositionTable.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+#include "Board/board.h"
+#include "simd.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::array;
+
+using board::board_state;
+using board_utils::parse_fen;
+using move_generator::attack_info;
+using move_generator::find_attack_info;
+using piece_attacks::init_all;
+using bitboard_utils::least_significant_bit_index;
+using bitboard_utils::pop_bit;
+using transposition_table::TranspositionTable;
+using namespace constants;
+
+
+namespace texel_tuner
+{
+    const int material_start = 0;
+    const int piece_square_start = 5;
+    const int mobility_start = piece_square_start + 6 * 64;
+    const int king_zone_index = mobility_start + 4;
+    const int n_attack_terms = 5;  // the mobility of knights to queens and the king zone, one column each from mobility_start
+    const int checked_positions = 256;  // per chunk, compared with the evaluation of the engine
+    const int report_interval = 25;  // epochs
+
+    // positions reduced to the counts of the parameters in their evaluation from the view of white, one column per
+    // field, so that the dense terms and the error are loops over arrays which the compiler vectorizes
+    struct position_set {
+        vector<uint32_t> first_piece;  // into the piece list
+        vector<uint8_t> n_pieces;
+        array<vector<float>, n_attack_terms> attack_counts;  // difference between white and black
+        vector<float> results;  // for white
+        vector<uint16_t> pieces;  // piece type * 64 + square from the view of its owner, times two plus one for black
+
+        // kept between the calls of the loss
+        vector<double> evaluations;
+        vector<double> slopes;
+
+        size_t size() const { return results.size(); }
+    };
+
+    int &parameter(evaluation_parameters &parameters, int index)
+    {
+        if (index < piece_square_start) return parameters.material[index];
+        if (index < mobility_start) return parameters.piece_square[(index - piece_square_start) / 64][(index - piece_square_start) % 64];
+        if (index < king_zone_index) return parameters.mobility[N + index - mobility_start];
+        return parameters.king_zone_attack;
+    }
+
+    string parameter_name(int index)
+    {
+        const string piece_names[6] = {"pawn", "knight", "bishop", "rook", "queen", "king"};
+        if (index < piece_square_start) return piece_names[index] + " material";
+        if (index < mobility_start)
+        {
+            int square = (index - piece_square_start) % 64;
+            return piece_names[(index - piece_square_start) / 64] + " on " + square_to_coordinates[square];
+        }
+        if (index < king_zone_index) return piece_names[N + index - mobility_start] + " mobility";
+        return "king zone attack";
+    }
+
+    string to_header(const evaluation_parameters &parameters)
+    {
+        // the layout of include/Engine/defaultParameters.h
+        auto row = [](const auto &values, int width) {
+            string text;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                string value = std::to_string(values[i]);
+                if (i > 0) text += ", ";
+                text += string(std::max(width - (int)value.size(), 0), ' ') + value;
+            }
+            return text;
+        };
+
+        std::ostringstream header;
+        header << "// generated by `engine tune`, the evaluation parameters found by texel tuning\n"
+               << "#ifndef default_evaluation_parameters\n#define default_evaluation_parameters\n\n"
+               << "#include \"Engine/evaluationParameters.h\"\n\n\n"
+               << "inline const evaluation_parameters default_parameters = {\n"
+               << "    {" << row(parameters.material, 0) << "},\n    {{\n";
+        for (int piece = P; piece <= K; piece++)
+        {
+            header << "        {\n";
+            for (int rank = 0; rank < 8; rank++)
+            {
+                array<int, 8> values;
+                std::copy_n(parameters.piece_square[piece].begin() + rank * 8, 8, values.begin());
+                header << "            " << row(values, 4) << ",\n";
+            }
+            header << "        }" << (piece < K ? "," : "") << "\n";
+        }
+        header << "    }},\n    {" << row(parameters.mobility, 0) << "},\n    " << parameters.king_zone_attack << ",\n    {{\n";
+        for (int attacker = P; attacker <= K; attacker++)
+        {
+            header << "        {" << row(parameters.mvv_lva[attacker], 0) << "}" << (attacker < K ? "," : "") << "\n";
+        }
+        header << "    }}\n};\n\n#endif  // default_evaluation_parameters\n";
+        return header.str();
+    }
+
+    bool parse_result(string_view rest, float &result)
+    {
+        if (rest.find("1/2-1/2") != string_view::npos) result = 0.5;
+        else if (rest.find("1-0") != string_view::npos) result = 1;
+        else if (rest.find("0-1") != string_view::npos) result = 0;
+        else
+        {
+            size_t open = rest.find('['), close = rest.find(']');
+            if (open == string_view::npos || close == string_view::npos || close < open) return false;
+            try
+            {
+                result = std::stof(string(rest.substr(open + 1, close - open - 1)));
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+        return result >= 0 && result <= 1;
+    }
+
+    void add_position(board_state &board, float result, position_set &set)
+    {
+        set.first_piece.push_back(set.pieces.size());
+        set.results.push_back(result);
+        int n_pieces = 0;
+        for (int piece = P; piece <= k; piece++)
+        {
+            U64 bitboard = board.bitboards[piece];
+            while (bitboard)
+            {
+                int square = least_significant_bit_index(bitboard);
+                bool is_black = piece > K;
+                int own_square = is_black ? (7 - square / 8) * 8 + square % 8 : square;
+                set.pieces.push_back(((piece % 6) * 64 + own_square) * 2 + is_black);
+                n_pieces++;
+                pop_bit(bitboard, square);
+            }
+        }
+        set.n_pieces.push_back(n_pieces);
+
+        // the same attack counts as in Engine::evaluate
+        attack_info attack_map = find_attack_info(board);
+        simd::u64x2 own_pieces = simd::load(board.occupancies);
+        for (int piece = N; piece <= Q; piece++)
+        {
+            simd::u64x2 mobility = simd::count_bits(simd::and_not(simd::make(attack_map.attacks_by_piece[piece], attack_map.attacks_by_piece[piece + 6]), own_pieces));
+            set.attack_counts[piece - N].push_back((int)simd::low(mobility) - (int)simd::high(mobility));
+        }
+        simd::u64x2 king_zone_attacks = simd::count_bits(simd::bit_and(simd::load(attack_map.attacked.data()), simd::make(attack_map.king_zone[black], attack_map.king_zone[white])));
+        set.attack_counts[king_zone_index - mobility_start].push_back((int)simd::low(king_zone_attacks) - (int)simd::high(king_zone_attacks));
+    }
+
+    double piece_evaluation(const position_set &set, size_t index, const double *weights)
+    {
+        // material and piece square tables, a short gather per position
+        double evaluation = 0;
+        const uint16_t *pieces = set.pieces.data() + set.first_piece[index];
+        for (int i = 0; i < set.n_pieces[index]; i++)
+        {
+            int piece_square = pieces[i] >> 1;
+            int piece_type = piece_square / 64;
+            double value = weights[piece_square_start + piece_square] + (piece_type < K ? weights[material_start + piece_type] : 0);
+            evaluation += pieces[i] & 1 ? -value : value;
+        }
+        return evaluation;
+    }
+
+    void linear_evaluations(position_set &set, const double *weights)
+    {
+        set.evaluations.resize(set.size());
+        double *evaluations = set.evaluations.data();
+        for (size_t i = 0; i < set.size(); i++) evaluations[i] = piece_evaluation(set, i, weights);
+        for (int term = 0; term < n_attack_terms; term++)
+        {
+            const float *counts = set.attack_counts[term].data();
+            double weight = weights[mobility_start + term];
+            for (size_t i = 0; i < set.size(); i++) evaluations[i] += weight * counts[i];
+        }
+    }
+
+    bool read_chunk(string_view text, position_set &set, U64 &skipped)
+    {
+        // every chunk compares its first positions with the engine, so the features can not drift from the evaluation
+        Engine engine(std::make_shared<TranspositionTable>(1));
+        array<double, n_parameters> defaults;
+        evaluation_parameters parameters = default_parameters;
+        for (int i = 0; i < n_parameters; i++) defaults[i] = parameter(parameters, i);
+
+        size_t position = 0;
+        while (position < text.size())
+        {
+            size_t end = text.find('\n', position);
+            if (end == string_view::npos) end = text.size();
+            string_view line = text.substr(position, end - position);
+            position = end + 1;
+
+            std::istringstream stream{string(line)};
+            array<string, 4> fields;
+            float result;
+            if (!(stream >> fields[0] >> fields[1] >> fields[2] >> fields[3]) || fields[0][0] == '#') continue;
+            string rest;
+            std::getline(stream, rest);
+            if (!parse_result(rest, result))
+            {
+                skipped++;
+                continue;
+            }
+
+            board_state board;
+            if (parse_fen(fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3], board) != board_utils::fen_error::none)
+            {
+                skipped++;
+                continue;
+            }
+            attack_info attack_map = find_attack_info(board);
+            if (move_generator::in_check(board, attack_map))
+            {
+                skipped++;  // not a quiet position
+                continue;
+            }
+
+            add_position(board, result, set);
+            if (set.size() <= checked_positions)
+            {
+                size_t index = set.size() - 1;
+                double evaluation = piece_evaluation(set, index, defaults.data());
+                for (int term = 0; term < n_attack_terms; term++) evaluation += defaults[mobility_start + term] * set.attack_counts[term][index];
+                int expected = engine.static_evaluation(board) * (board.side == white ? 1 : -1);
+                if (std::lround(evaluation) != expected)
+                {
+                    cerr << "the tuner does not match Engine::evaluate for " << line << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    double sigmoid(double evaluation, double scaling)
+    {
+        return 1 / (1 + std::exp(-scaling * evaluation * std::log(10.0) / 400));
+    }
+
+    // the squared error summed over the positions of one set, and its gradient added to the given one
+    double set_loss(position_set &set, const double *weights, double scaling, double *gradient)
+    {
+        linear_evaluations(set, weights);
+        set.slopes.resize(set.size());
+        const double *evaluations = set.evaluations.data();
+        const float *results = set.results.data();
+        double *slopes = set.slopes.data();
+        const double exponent_scale = -scaling * std::log(10.0) / 400;
+        double error = 0;
+        for (size_t i = 0; i < set.size(); i++)
+        {
+            double expected = 1 / (1 + std::exp(exponent_scale * evaluations[i]));
+            double difference = expected - results[i];
+            error += difference * difference;
+            // the derivative of the squared error by the evaluation
+            slopes[i] = -2 * difference * expected * (1 - expected) * exponent_scale;
+        }
+        if (gradient == nullptr) return error;
+
+        // spread over the counts, the dense terms are dot products and the pieces are scattered
+        for (int term = 0; term < n_attack_terms; term++)
+        {
+            const float *counts = set.attack_counts[term].data();
+            double sum = 0;
+            for (size_t i = 0; i < set.size(); i++) sum += slopes[i] * counts[i];
+            gradient[mobility_start + term] += sum;
+        }
+        for (size_t i = 0; i < set.size(); i++)
+        {
+            const uint16_t *pieces = set.pieces.data() + set.first_piece[i];
+            for (int j = 0; j < set.n_pieces[i]; j++)
+            {
+                double signed_slope = pieces[j] & 1 ? -slopes[i] : slopes[i];
+                int piece_square = pieces[j] >> 1;
+                gradient[piece_square_start + piece_square] += signed_slope;
+                if (piece_square / 64 < K) gradient[material_start + piece_square / 64] += signed_slope;
+            }
+        }
+        return error;
+    }
+
+    // one thread per position set, started once for the whole run. the loss is called about a hundred times
+    // by fit_scaling and once per epoch, and every call hands the same sets to the same threads
+    class LossWorkers {
+        public:
+            LossWorkers(vector<position_set> &position_sets) : sets(position_sets), errors(sets.size()), gradients(sets.size())
+            {
+                for (const position_set &set : sets) n_positions += set.size();
+                for (size_t t = 1; t < sets.size(); t++) threads.emplace_back(&LossWorkers::worker_loop, this, t);
+            }
+
+            ~LossWorkers()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                work_ready.notify_all();
+                for (std::thread &thread : threads) thread.join();
+            }
+
+            // the mean squared error, and its gradient if one is given, over all positions
+            double loss(const vector<double> &weights, double scaling, vector<double> *gradient)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    job_weights = weights.data();
+                    job_scaling = scaling;
+                    job_gradient = gradient != nullptr;
+                    pending = threads.size();
+                    generation++;
+                }
+                work_ready.notify_all();
+                compute(0);  // the calling thread takes the first set
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    work_done.wait(lock, [this]() { return pending == 0; });
+                }
+
+                double total = 0;
+                for (double error : errors) total += error;
+                if (gradient != nullptr)
+                {
+                    gradient->assign(n_parameters, 0);
+                    for (const vector<double> &thread_gradient : gradients)
+                    {
+                        for (int i = 0; i < n_parameters; i++) (*gradient)[i] += thread_gradient[i] / n_positions;
+                    }
+                }
+                return total / std::max<size_t>(n_positions, 1);
+            }
+
+        private:
+            void compute(size_t t)
+            {
+                double *gradient = nullptr;
+                if (job_gradient)
+                {
+                    gradients[t].assign(n_parameters, 0);
+                    gradient = gradients[t].data();
+                }
+                errors[t] = set_loss(sets[t], job_weights, job_scaling, gradient);
+            }
+
+            void worker_loop(size_t t)
+            {
+                int done_generation = 0;
+                while (true)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        work_ready.wait(lock, [&]() { return stopping || generation != done_generation; });
+                        if (stopping) return;
+                        done_generation = generation;
+                    }
+                    compute(t);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        pending--;
+                    }
+                    work_done.notify_one();
+                }
+            }
+
+            vector<position_set> &sets;
+            size_t n_positions = 0;
+            vector<double> errors;
+            vector<vector<double>> gradients;  // per set, n_parameters each when a gradient is asked for
+            vector<std::thread> threads;
+
+            std::mutex mutex;
+            std::condition_variable work_ready;
+            std::condition_variable work_done;
+            int generation = 0;
+            size_t pending = 0;
+            bool stopping = false;
+            const double *job_weights = nullptr;
+            double job_scaling = 0;
+            bool job_gradient = false;
+    };
+
+    double fit_scaling(LossWorkers &workers, const vector<double> &weights)
+    {
+        // the loss is smooth in the scaling, a golden section search finds its minimum
+        double low = 0.1, high = 5;
+        const double ratio = (std::sqrt(5.0) - 1) / 2;
+        for (int i = 0; i < 40; i++)
+        {
+            double a = high - ratio * (high - low), b = low + ratio * (high - low);
+            if (workers.loss(weights, a, nullptr) < workers.loss(weights, b, nullptr)) high = b;
+            else low = a;
+        }
+        return (low + high) / 2;
+    }
+
+    int run(const tuner_options &options)
+    {
+        init_all();
+        auto start_time = std::chrono::steady_clock::now();
+        int threads = options.threads > 0 ? options.threads : std::max((int)std::thread::hardware_concurrency(), 1);
+
+        // every thread reads a part of the files and keeps its positions for the tuning
+        vector<position_set> sets(threads);
+        U64 skipped = 0;
+        for (const string &path : options.input_paths)
+        {
+            MappedFile file;
+            if (!file.open(path))
+            {
+                cerr << "could not open " << path << endl;
+                return 1;
+            }
+            string_view text = file.contents();
+            vector<size_t> boundaries = {0};
+            for (int t = 1; t < threads; t++)
+            {
+                size_t boundary = text.find('\n', std::max(text.size() / threads * t, boundaries.back()));
+                boundaries.push_back(boundary == string_view::npos ? text.size() : boundary + 1);
+            }
+            boundaries.push_back(text.size());
+
+            vector<U64> thread_skipped(threads);
+            vector<char> ok(threads);
+            vector<std::thread> readers;
+            for (int t = 0; t < threads; t++)
+            {
+                readers.emplace_back([&, t]() { ok[t] = read_chunk(text.substr(boundaries[t], boundaries[t + 1] - boundaries[t]), sets[t], thread_skipped[t]); });
+            }
+            for (std::thread &reader : readers) reader.join();
+            if (std::find(ok.begin(), ok.end(), false) != ok.end()) return 1;
+            for (U64 count : thread_skipped) skipped += count;
+        }
+
+        size_t n_positions = 0;
+        for (const position_set &set : sets) n_positions += set.size();
+        double load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        cerr << n_positions << " positions loaded in " << load_seconds << " s, " << skipped << " lines skipped" << endl;
+        if (n_positions == 0) return 1;
+
+        evaluation_parameters parameters = default_parameters;
+        vector<double> weights(n_parameters);
+        for (int i = 0; i < n_parameters; i++) weights[i] = parameter(parameters, i);
+
+        LossWorkers workers(sets);
+        double scaling = options.scaling > 0 ? options.scaling : fit_scaling(workers, weights);
+        cerr << "scaling " << scaling << ", loss " << workers.loss(weights, scaling, nullptr) << endl;
+
+        // adam, the parameters differ a lot in how often they occur
+        vector<double> gradient, first_moment(n_parameters), second_moment(n_parameters);
+        const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+        for (int epoch = 1; epoch <= options.epochs; epoch++)
+        {
+            double current_loss = workers.loss(weights, scaling, &gradient);
+            for (int i = 0; i < n_parameters; i++)
+            {
+                first_moment[i] = beta1 * first_moment[i] + (1 - beta1) * gradient[i];
+                second_moment[i] = beta2 * second_moment[i] + (1 - beta2) * gradient[i] * gradient[i];
+                double corrected_first = first_moment[i] / (1 - std::pow(beta1, epoch));
+                double corrected_second = second_moment[i] / (1 - std::pow(beta2, epoch));
+                weights[i] -= options.learning_rate * corrected_first / (std::sqrt(corrected_second) + epsilon);
+            }
+            if (epoch % report_interval == 0 || epoch == options.epochs)
+            {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+                cerr << "epoch " << epoch << ", loss " << current_loss << ", " << (int)seconds << " s" << endl;
+            }
+        }
+
+        for (int i = 0; i < n_parameters; i++)
+        {
+            parameter(parameters, i) = std::lround(weights[i]);
+            weights[i] = parameter(parameters, i);
+        }
+        cerr << "final loss " << workers.loss(weights, scaling, nullptr) << " with the rounded parameters" << endl;
+
+        std::ofstream output(options.output_path);
+        output << to_header(parameters);
+        if (!output)
+        {
+            cerr << "could not write " << options.output_path << endl;
+            return 1;
+        }
+        cerr << "parameters written to " << options.output_path << endl;
+        return 0;
+    }
+}
@@ -0,0 +1,51 @@
+#include "engineContext.h"
+#include "uci.h"
+#include "Board/board.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <memory>
+
+using board::make_move;
+using board_utils::parse_fen;
+using piece_attacks::init_all;
+
+
+const string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+EngineContext::EngineContext() : EngineContext(std::make_shared<TranspositionTable>()) {}
+EngineContext::EngineContext(std::shared_ptr<TranspositionTable> shared_table)
+{
+    // the attack tables and zobrist keys are needed before the first position can be parsed
+    init_all();
+    search_engine = std::make_unique<Engine>(shared_table);
+    set_position(start_position);
+}
+
+bool EngineContext::set_position(const string &fen)
+{
+    board_utils::fen_error error;
+    return set_position(fen, error);
+}
+
+bool EngineContext::set_position(const string &fen, board_utils::fen_error &error)
+{
+    board_state parsed;
+    error = parse_fen(fen, parsed);
+    if (error != board_utils::fen_error::none) return false;
+    board = parsed;
+    search_engine->clear_history();
+    return true;
+}
+
+bool EngineContext::play_move(const string &move)
+{
+    unsigned int legal_move = uci::parse_move(board, move);
+    if (legal_move == 0) return false;
+
+    search_engine->add_to_history(board.zobrist_hash);
+    board = make_move(board, legal_move);
+    return true;
+}
+
+board_state& EngineContext::position() { return board; }
+Engine& EngineContext::engine() { return *search_engine; }
@@ -1,78 +1,373 @@
 #include <iostream>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <array>
+#include <vector>
+#include <span>
 
-#include "utils.h"
-#include "Board/board.h"
 #include "MoveGenerator/AttackTables.h"
-#include "MoveGenerator/MoveGenerator.h"
-#include "Engine/engine.h"
+#include "uci.h"
+#include "Tools/analysisServer.h"
+#include "Tools/batchAnalysis.h"
+#include "Tools/pgnReader.h"
+#include "Tools/openingBook.h"
+#include "Tools/matchRunner.h"
+#include "Tools/texelTuner.h"
+#include "Tools/dataGenerator.h"
+#include "Tools/positionIndex.h"
+#include "engineContext.h"
 
-using std::cout;
+using std::cerr;
 using std::endl;
-
-using namespace constants;
-using move_generator::generate_moves;
-using move_generator::print_move_list;
-using move_generator::perft;
-using move_generator::perft_debug;
-using move_generator::perft_test_all_moves;
+using std::string;
 using piece_attacks::init_all;
-using piece_attacks::align_mask;
 
-using board::board_state;
-using board::encode_move;
-using board::make_move;
-using board::move_to_string;
-using board::is_promoting;
-using board_utils::parse_fen;
-using board_utils::print_board;
-using bitboard_utils::print_bitboard;
 
+int server_main(int argc, char *argv[])
+{
+    analysis_server::server_options options;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--port" && has_value) options.port = std::stoi(argv[++i]);
+        else if (argument == "--socket" && has_value) options.socket_path = argv[++i];
+        else if (argument == "--workers" && has_value) options.workers = std::stoi(argv[++i]);
+        else if (argument == "--hash" && has_value) options.hash_mb = std::stoi(argv[++i]);
+        else if (argument == "--connections" && has_value) options.max_connections = std::stoi(argv[++i]);
+        else
+        {
+            cerr << "usage: " << argv[0] << " server [--port N | --socket PATH] [--workers N] [--hash MB] [--connections N]" << endl;
+            return 1;
+        }
+    }
+    return analysis_server::run(options);
+}
+
+int batch_main(int argc, char *argv[])
+{
+    batch_analysis::batch_options options;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--input" && has_value) options.input_path = argv[++i];
+        else if (argument == "--output" && has_value) options.output_path = argv[++i];
+        else if (argument == "--threads" && has_value) options.threads = std::stoi(argv[++i]);
+        else if (argument == "--depth" && has_value) options.depth = std::stoi(argv[++i]);
+        else if (argument == "--nodes" && has_value) options.nodes = std::stoll(argv[++i]);
+        else if (argument == "--hash" && has_value) options.hash_mb = std::stoi(argv[++i]);
+        else
+        {
+            cerr << "usage: " << argv[0] << " batch [--input FILE] [--output FILE] [--threads N] [--depth N] [--nodes N] [--hash MB]" << endl;
+            return 1;
+        }
+    }
+    return batch_analysis::run(options);
+}
+
+int pgn_main(int argc, char *argv[])
+{
+    // replays every game of a file, to check it and to measure the reading speed
+    string path;
+    int threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--input" && has_value) path = argv[++i];
+        else if (argument == "--threads" && has_value) threads = std::stoi(argv[++i]);
+        else
+        {
+            path.clear();
+            break;
+        }
+    }
+    if (path.empty())
+    {
+        cerr << "usage: " << argv[0] << " pgn --input FILE [--threads N]" << endl;
+        return 1;
+    }
+
+    pgn_reader::read_statistics statistics;
+    if (!pgn_reader::read_file(path, threads, [](const pgn_reader::pgn_game &, int) {}, statistics))
+    {
+        cerr << "could not open " << path << endl;
+        return 1;
+    }
+    double seconds = std::max(statistics.seconds, 0.001);
+    std::cout << statistics.games << " games, " << statistics.invalid_games << " not replayed completely, "
+              << statistics.positions << " positions in " << seconds << " s, "
+              << (U64)(statistics.positions / seconds) << " positions/s, "
+              << (U64)(statistics.bytes / seconds / (1 << 20)) << " MB/s" << endl;
+    return 0;
+}
+
+int book_main(int argc, char *argv[])
+{
+    opening_book::build_options options;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--output" && has_value) options.output_path = argv[++i];
+        else if (argument == "--threads" && has_value) options.threads = std::stoi(argv[++i]);
+        else if (argument == "--max-ply" && has_value) options.max_ply = std::stoi(argv[++i]);
+        else if (argument == "--min-games" && has_value) options.min_games = std::stoi(argv[++i]);
+        else if (argument == "--min-score" && has_value) options.min_score = std::stod(argv[++i]);
+        else if (argument == "--memory" && has_value) options.memory_mb = std::stoul(argv[++i]);
+        else if (!argument.starts_with("--")) options.input_paths.push_back(argument);
+        else
+        {
+            options.input_paths.clear();
+            break;
+        }
+    }
+    if (options.output_path.empty() || options.input_paths.empty())
+    {
+        cerr << "usage: " << argv[0] << " book --output FILE [--threads N] [--max-ply N] [--min-games N] [--min-score X] [--memory MB] GAMES.pgn..." << endl;
+        return 1;
+    }
+    return opening_book::build(options);
+}
+
+int book_probe_main(int argc, char *argv[])
+{
+    // lists the book moves of a position, the start position by default
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " book-probe BOOK [FEN]" << endl;
+        return 1;
+    }
+    opening_book::OpeningBook book;
+    if (!book.open(argv[2]))
+    {
+        cerr << "could not open the book " << argv[2] << endl;
+        return 1;
+    }
+    EngineContext context;
+    board_utils::fen_error error;
+    if (argc > 3 && !context.set_position(argv[3], error))
+    {
+        cerr << "invalid fen: " << board_utils::fen_error_text(error) << endl;
+        return 1;
+    }
+    for (const opening_book::book_entry &entry : book.find(context.position().zobrist_hash))
+    {
+        std::cout << uci::move_to_uci(entry.move) << " games " << entry.games << " score "
+                  << (int)(100 * (entry.wins + 0.5 * entry.draws) / entry.games) << "%" << endl;
+    }
+    unsigned int move = book.probe(context.position());
+    std::cout << "book move " << (move != 0 ? uci::move_to_uci(move) : "none") << endl;
+    return 0;
+}
+
+int match_main(int argc, char *argv[])
+{
+    // without engine commands this build plays itself, with the configurations given by the options
+    match_runner::match_options options;
+    options.engines[0].command = options.engines[1].command = argv[0];
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!has_value)
+        {
+            valid = false;
+            break;
+        }
+        string value = argv[++i];
+        if (argument == "--engine1") options.engines[0].command = value;
+        else if (argument == "--engine2") options.engines[1].command = value;
+        else if ((argument == "--option1" || argument == "--option2") && value.find('=') != string::npos)
+        {
+            options.engines[argument == "--option1" ? 0 : 1].options.emplace_back(value.substr(0, value.find('=')), value.substr(value.find('=') + 1));
+        }
+        else if (argument == "--openings") options.openings_path = value;
+        else if (argument == "--pgn") options.pgn_path = value;
+        else if (argument == "--games") options.games = std::stoi(value);
+        else if (argument == "--concurrency") options.concurrency = std::stoi(value);
+        else if (argument == "--tc")
+        {
+            // seconds for the game and the increment, as in 10+0.1
+            size_t plus = value.find('+');
+            options.base_milli_seconds = std::stod(value.substr(0, plus)) * 1000;
+            options.increment_milli_seconds = plus == string::npos ? 0 : std::stod(value.substr(plus + 1)) * 1000;
+        }
+        else if (argument == "--sprt" && value.find(',') != string::npos)
+        {
+            options.sprt = true;
+            options.elo0 = std::stod(value.substr(0, value.find(',')));
+            options.elo1 = std::stod(value.substr(value.find(',') + 1));
+        }
+        else valid = false;
+    }
+    if (!valid)
+    {
+        cerr << "usage: " << argv[0] << " match [--engine1 CMD] [--engine2 CMD] [--option1 NAME=VALUE] [--option2 NAME=VALUE] [--openings FILE]"
+             << " [--pgn FILE] [--games N] [--concurrency N] [--tc SECONDS+INCREMENT] [--sprt ELO0,ELO1]" << endl;
+        return 1;
+    }
+    return match_runner::run(options);
+}
+
+int tune_main(int argc, char *argv[])
+{
+    texel_tuner::tuner_options options;
+    bool valid = true;
+    for (int i = 2; i < argc && valid; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--output" && has_value) options.output_path = argv[++i];
+        else if (argument == "--threads" && has_value) options.threads = std::stoi(argv[++i]);
+        else if (argument == "--epochs" && has_value) options.epochs = std::stoi(argv[++i]);
+        else if (argument == "--learning-rate" && has_value) options.learning_rate = std::stod(argv[++i]);
+        else if (argument == "--scaling" && has_value) options.scaling = std::stod(argv[++i]);
+        else if (!argument.starts_with("--")) options.input_paths.push_back(argument);
+        else valid = false;
+    }
+    if (!valid || options.input_paths.empty())
+    {
+        cerr << "usage: " << argv[0] << " tune [--output FILE] [--threads N] [--epochs N] [--learning-rate X] [--scaling X] POSITIONS..." << endl;
+        return 1;
+    }
+    return texel_tuner::run(options);
+}
+
+int datagen_main(int argc, char *argv[])
+{
+    data_generator::generator_options options;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--output" && has_value) options.output_prefix = argv[++i];
+        else if (argument == "--threads" && has_value) options.threads = std::stoi(argv[++i]);
+        else if (argument == "--shards" && has_value) options.shards = std::stoi(argv[++i]);
+        else if (argument == "--positions" && has_value) options.positions = std::stoull(argv[++i]);
+        else if (argument == "--nodes" && has_value) options.nodes = std::stoll(argv[++i]);
+        else if (argument == "--random-plies" && has_value) options.random_plies = std::stoi(argv[++i]);
+        else if (argument == "--hash" && has_value) options.hash_mb = std::stoi(argv[++i]);
+        else if (argument == "--seed" && has_value) options.seed = std::stoull(argv[++i]);
+        else
+        {
+            cerr << "usage: " << argv[0] << " datagen [--output PREFIX] [--threads N] [--shards N] [--positions N] [--nodes N] [--random-plies N] [--hash MB] [--seed N]" << endl;
+            return 1;
+        }
+    }
+    return data_generator::run(options);
+}
+
+int index_main(int argc, char *argv[])
+{
+    position_index::index_options options;
+    for (int i = 2; i < argc; i++)
+    {
+        string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--index" && has_value) options.index_path = argv[++i];
+        else if (argument == "--threads" && has_value) options.threads = std::stoi(argv[++i]);
+        else if (argument == "--max-ply" && has_value) options.max_ply = std::stoi(argv[++i]);
+        else if (!argument.starts_with("--")) options.input_paths.push_back(argument);
+        else
+        {
+            options.input_paths.clear();
+            break;
+        }
+    }
+    if (options.index_path.empty() || options.input_paths.empty())
+    {
+        cerr << "usage: " << argv[0] << " index --index FILE [--threads N] [--max-ply N] GAMES.pgn..." << endl;
+        return 1;
+    }
+    return position_index::update(options);
+}
+
+int index_probe_main(int argc, char *argv[])
+{
+    // the moves played from a position and the games reaching it, the start position by default
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " index-probe INDEX [FEN] [--games N]" << endl;
+        return 1;
+    }
+    position_index::PositionIndex index;
+    if (!index.open(argv[2]))
+    {
+        cerr << "could not open the index " << argv[2] << endl;
+        return 1;
+    }
+    EngineContext context;
+    size_t max_games = 10;
+    for (int i = 3; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (argument == "--games" && i + 1 < argc) max_games = std::stoul(argv[++i]);
+        else
+        {
+            board_utils::fen_error error;
+            if (!context.set_position(argument, error))
+            {
+                cerr << "invalid fen: " << board_utils::fen_error_text(error) << endl;
+                return 1;
+            }
+        }
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    span<const position_index::index_entry> entries = index.find(context.position().zobrist_hash);
+    double micro_seconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+
+    // the results are from the view of white
+    std::map<unsigned int, array<int, 4>> moves;
+    vector<U64> games;
+    for (const position_index::index_entry &entry : entries)
+    {
+        moves[entry.move][entry.result]++;
+        if (games.empty() || games.back() != entry.game) games.push_back(entry.game);
+    }
+    std::cout << games.size() << " games found in " << micro_seconds << " us" << endl;
+    for (const auto &[move, results] : moves)
+    {
+        string name = move == 0 ? "end" : pgn_reader::move_to_san(context.position(), move);
+        std::cout << name << " games " << results[0] + results[1] + results[2] + results[3]
+                  << " white " << results[2] << " draw " << results[1] << " black " << results[0] << endl;
+    }
+
+    for (size_t i = 0; i < games.size() && i < max_games; i++)
+    {
+        const position_index::indexed_file &file = index.files()[position_index::game_file(games[i])];
+        MappedFile pgn;
+        pgn_reader::pgn_game game;
+        if (pgn.open(file.path, false)) pgn_reader::read_game(pgn.contents(), position_index::game_offset(games[i]), game);
+        std::cout << file.path << ":" << position_index::game_offset(games[i]) << " " << game.tag("White") << " - "
+                  << game.tag("Black") << " " << game.result << endl;
+    }
+    return 0;
+}
 
-int main()
+int main(int argc, char *argv[])
 {
-    string empty_position = "8/8/8/8/8/8/8/8 w - - 0 1";
-    string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
-    string perft_position_2 = "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -";
-    string perft_position_3 = "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -";
-    string perft_position_4 = "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1";
-    string perft_position_5 = "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8";
-    string perft_position_6 = "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10";
+    // without a command the engine speaks uci on the standard streams
+    string command = argc > 1 ? argv[1] : "uci";
+    if (command == "server") return server_main(argc, argv);
+    if (command == "batch") return batch_main(argc, argv);
+    if (command == "pgn") return pgn_main(argc, argv);
+    if (command == "book") return book_main(argc, argv);
+    if (command == "book-probe") return book_probe_main(argc, argv);
+    if (command == "match") return match_main(argc, argv);
+    if (command == "tune") return tune_main(argc, argv);
+    if (command == "datagen") return datagen_main(argc, argv);
+    if (command == "index") return index_main(argc, argv);
+    if (command == "index-probe") return index_probe_main(argc, argv);
 
     init_all();
-    // board_state state = parse_fen("2kr1bnr/pppqpppp/2n1b3/3p4/4P3/5N2/PPPPBPPP/RNBQR1K1 w - - 0 1");
-    // state = make_move(state, encode_move(b1, c3, N, no_promotion, no_piece, 0, 0, 0));
-    // print_board(state);
-
-    // board_state state2 = parse_fen(start_position);
-    // state2 = make_move(state2, encode_move(e2, e4, P, no_promotion, no_piece, 1, 0, 0));
-    // state2 = make_move(state2, encode_move(d7, d5, p, no_promotion, no_piece, 1, 0, 0));
-    // state2 = make_move(state2, encode_move(g1, f3, N, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(b8, c6, n, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(f1, e2, B, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(c8, e6, b, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(e1, g1, K, no_promotion, no_piece, 0, 0, 1));
-    // state2 = make_move(state2, encode_move(d8, d7, q, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(f1, e1, R, no_promotion, no_piece, 0, 0, 0));
-    // state2 = make_move(state2, encode_move(e8, c8, k, no_promotion, no_piece, 0, 0, 1));
-    // print_board(state2);
-
-    // array<unsigned int, max_moves> move_list;
-    // span<unsigned int> moves = generate_moves(state, move_list, false);
-
-    // Engine engine;
-    // engine.iterative_search(state, 6);
-
-    // board_state state = parse_fen("r5rk/2p1Nppp/3p3P/pp2p1P1/4P3/2qnPQK1/8/R6R w - - 1 0");
-    // board_state state = parse_fen("r1bk3r/pppq1ppp/5n2/4N1N1/2Bp4/Bn6/P4PPP/4R1K1 w - - 1 0");
-    // board_state state = parse_fen("r2n1rk1/1ppb2pp/1p1p4/3Ppq1n/2B3P1/2P4P/PP1N1P1K/R2Q1RN1 b - - 0 1");
-    // state = make_move(state, encode_move(f5, f2, q, no_promotion, P, 1, 0, 0));
-    // board_state state = parse_fen("r1bnk2r/pppp1ppp/1b4q1/4P3/2B1N3/Q1Pp1N2/P4PPP/R3R1K1 w - - 1 0");
-    // print_board(state);
-    // Engine engine;
-    // engine.iterative_search(state, 5000);
-    // cout << move_to_string(engine.best_move()) << endl;
-    board_state state = parse_fen(start_position);
-    print_board(state);
+    uci::loop();
 
     return 0;
 }
@@ -0,0 +1,306 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <array>
+#include <span>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cctype>
+#include <algorithm>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+#include <charconv>
+
+#include "uci.h"
+#include "utils.h"
+#include "Board/board.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "Engine/engine.h"
+#include "engineContext.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::istringstream;
+using std::array;
+using std::span;
+
+using namespace constants;
+using board::board_state;
+using board::move_source;
+using board::move_target;
+using board::move_promotion;
+using move_generator::generate_moves;
+
+
+namespace uci
+{
+    const int max_threads = 256;
+    const int max_hash_mb = 65536;
+    const string start_position = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+    string move_to_uci(unsigned int move)
+    {
+        string uci_move = square_to_coordinates[move_source(move)] + square_to_coordinates[move_target(move)];
+        if (move_promotion(move) != no_promotion) uci_move += static_cast<char>(tolower(promotion_to_string[move_promotion(move)]));
+        return uci_move;
+    }
+
+    unsigned int parse_move(board_state &board, const string &move)
+    {
+        // compare against the legal moves, so that the special move flags are set correctly
+        array<unsigned int, max_moves> move_list;
+        span<unsigned int> moves = generate_moves(board, move_list, false);
+        for (unsigned int legal_move : moves)
+        {
+            if (move_to_uci(legal_move) == move) return legal_move;
+        }
+        return 0;
+    }
+
+    bool is_mate_score(int evaluation) { return abs(evaluation) > check_mate_score - 1000; }
+
+    int mate_distance(int evaluation)
+    {
+        // mate scores are check_mate_score minus the distance in plies
+        if (!is_mate_score(evaluation)) return 0;
+        int plies = check_mate_score - abs(evaluation);
+        int moves = (plies + 1) / 2;
+        return evaluation > 0 ? moves : -moves;
+    }
+
+    string score_to_uci(int evaluation)
+    {
+        if (is_mate_score(evaluation)) return "mate " + std::to_string(mate_distance(evaluation));
+        return "cp " + std::to_string(evaluation);
+    }
+
+    void print_info(const search_info &info)
+    {
+        cout << "info depth " << info.depth << " seldepth " << info.selective_depth;
+        cout << " multipv " << info.multi_pv;
+        cout << " score " << score_to_uci(info.evaluation);
+        cout << " nodes " << info.nodes << " nps " << info.nodes_per_second;
+        cout << " hashfull " << info.hashfull << " time " << info.time;
+        cout << " pv";
+        for (unsigned int move : info.principal_variation) cout << " " << move_to_uci(move);
+        cout << endl;
+    }
+
+    bool parse_int(const string &text, int &value)
+    {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    }
+
+    void position(istringstream &stream, EngineContext &context)
+    {
+        string token;
+        stream >> token;
+        if (token == "startpos")
+        {
+            context.set_position(start_position);
+            stream >> token;
+        }
+        else if (token == "fen")
+        {
+            string fen;
+            while (stream >> token && token != "moves") fen += token + " ";
+            board_utils::fen_error error;
+            if (!context.set_position(fen, error))
+            {
+                // the moves would be played from the previous position, so the command is ignored
+                cout << "info string invalid position: " << board_utils::fen_error_text(error) << endl;
+                return;
+            }
+        }
+
+        if (token != "moves") return;
+        while (stream >> token)
+        {
+            if (!context.play_move(token)) break;
+        }
+    }
+
+    search_limits go(istringstream &stream, board_state &board, bool &infinite)
+    {
+        search_limits limits;
+        string token;
+        int value;
+        infinite = false;
+        while (stream >> token)
+        {
+            if (token == "infinite") { infinite = true; continue; }
+            if (token == "ponder") { limits.ponder = true; continue; }
+            if (!(stream >> value)) break;
+            if ((token == "wtime" && board.side == white) || (token == "btime" && board.side == black)) limits.time_left = value;
+            else if ((token == "winc" && board.side == white) || (token == "binc" && board.side == black)) limits.increment = value;
+            else if (token == "movestogo") limits.moves_to_go = value;
+            else if (token == "movetime") limits.move_time = value;
+            else if (token == "depth") limits.depth = value;
+            else if (token == "nodes") limits.nodes = value;
+        }
+        return limits;
+    }
+
+    void loop()
+    {
+        EngineContext context;
+        Engine *engine = &context.engine();
+        engine->set_info_callback(print_info);
+        std::thread search_thread;
+        std::atomic<bool> stop_requested{false};
+        std::atomic<bool> searching{false};
+        std::atomic<bool> pondering{false};
+
+        // the experience file is saved and read in the background, one task after another, and a search
+        // can start while it is still loading
+        string experience_path;
+        int hash_mb = transposition_table::default_size_mb;
+        std::thread experience_thread;
+        auto in_background = [&](std::function<void()> task)
+        {
+            if (experience_thread.joinable()) experience_thread.join();
+            experience_thread = std::thread(std::move(task));
+        };
+        auto replace_table = [&]()
+        {
+            // the old table is saved while the engine continues with a new one, seeded from the saved file
+            std::shared_ptr<TranspositionTable> old_table = engine->get_transposition_table();
+            std::shared_ptr<TranspositionTable> new_table = std::make_shared<TranspositionTable>(hash_mb);
+            engine->set_transposition_table(new_table);
+            if (experience_path.empty()) return;
+            in_background([old_table, new_table, path = experience_path]()
+            {
+                old_table->save_experience(path);
+                new_table->load_experience(path);
+            });
+        };
+
+        auto wait_for_search = [&]()
+        {
+            if (search_thread.joinable()) search_thread.join();
+        };
+        auto stop_search = [&]()
+        {
+            // repeat the stop request in case it arrived before the search reset its flag
+            stop_requested = true;
+            while (searching)
+            {
+                engine->stop();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            wait_for_search();
+        };
+
+        string line;
+        while (std::getline(std::cin, line))
+        {
+            istringstream stream(line);
+            string command;
+            stream >> command;
+
+            if (command == "uci")
+            {
+                cout << "id name Cpp-Chess" << endl;
+                cout << "id author naapeli" << endl;
+                cout << "option name Ponder type check default false" << endl;
+                cout << "option name MultiPV type spin default 1 min 1 max " << max_moves << endl;
+                cout << "option name Threads type spin default 1 min 1 max " << max_threads << endl;
+                cout << "option name Hash type spin default " << transposition_table::default_size_mb << " min 1 max " << max_hash_mb << endl;
+                cout << "option name ExperienceFile type string default <empty>" << endl;
+                cout << "uciok" << endl;
+            }
+            else if (command == "isready")
+            {
+                cout << "readyok" << endl;
+            }
+            else if (command == "setoption")
+            {
+                string token, name, value;
+                stream >> token;  // name
+                while (stream >> token && token != "value") name += token;
+                std::getline(stream >> std::ws, value);  // the rest of the line, a path may contain spaces
+                while (!value.empty() && isspace((unsigned char)value.back())) value.pop_back();
+
+                // the helpers and the table are replaced, so a running search is stopped first
+                int number;
+                bool is_number = parse_int(value, number);
+                if ((name == "MultiPV" || name == "Threads" || name == "Hash") && is_number) stop_search();
+                if (name == "MultiPV" && is_number) engine->set_multi_pv(number);
+                if (name == "Threads" && is_number) engine->set_threads(std::clamp(number, 1, max_threads));
+                if (name == "Hash" && is_number)
+                {
+                    hash_mb = std::clamp(number, 1, max_hash_mb);
+                    replace_table();
+                }
+                if (name == "ExperienceFile")
+                {
+                    string old_path = experience_path;
+                    experience_path = value == "<empty>" ? "" : value;
+                    in_background([table = engine->get_transposition_table(), old_path, new_path = experience_path]()
+                    {
+                        if (!old_path.empty()) table->save_experience(old_path);
+                        if (!new_path.empty()) table->load_experience(new_path);
+                    });
+                }
+            }
+            else if (command == "ucinewgame")
+            {
+                wait_for_search();
+                context.set_position(start_position);
+                replace_table();
+            }
+            else if (command == "position")
+            {
+                wait_for_search();
+                position(stream, context);
+            }
+            else if (command == "go")
+            {
+                wait_for_search();
+                bool infinite;
+                search_limits limits = go(stream, context.position(), infinite);
+                stop_requested = false;
+                searching = true;
+                pondering = limits.ponder;
+                search_thread = std::thread([&, limits, infinite]()
+                {
+                    board_state root = context.position();
+                    engine->iterative_search(root, limits);
+
+                    // in infinite and ponder mode the best move is only reported after stop or ponderhit
+                    while ((infinite || pondering) && !stop_requested) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    // 0000 is the null move, there is no legal move after a mate or a stalemate
+                    unsigned int best_move = engine->best_move();
+                    cout << "bestmove " << (best_move != 0 ? move_to_uci(best_move) : "0000");
+                    unsigned int ponder_move = engine->ponder_move(root);
+                    if (ponder_move != 0) cout << " ponder " << move_to_uci(ponder_move);
+                    cout << endl;
+                    searching = false;
+                });
+            }
+            else if (command == "ponderhit")
+            {
+                // the opponent played the expected move, continue the same search on our own clock
+                pondering = false;
+                engine->ponder_hit();
+            }
+            else if (command == "stop")
+            {
+                stop_search();
+            }
+            else if (command == "quit")
+            {
+                break;
+            }
+        }
+        stop_search();
+
+        // the process ends after this, so the last save has to be waited for
+        if (experience_thread.joinable()) experience_thread.join();
+        if (!experience_path.empty()) engine->get_transposition_table()->save_experience(experience_path);
+    }
+}
@@ -5,36 +5,67 @@
 #include <span>
 #include <algorithm>
 #include <iostream>
+#include <memory>
+#include <cctype>
 
 #include "utils.h"
 #include "wasm_wrapper.h"
 #include "Board/board.h"
 #include "MoveGenerator/MoveGenerator.h"
 #include "MoveGenerator/AttackTables.h"
+#include "uci.h"
 
-using board::encode_move;
-using board::make_move;
 using board::move_to_string;
-using board_utils::parse_fen;
-using move_generator::generate_moves;
 using piece_attacks::init_all;
+using time_manager::search_limits;
 
 using std::string;
 using std::array;
 using std::span;
 
+// progress reported to the page: depth, selective depth, line, evaluation, nodes, nodes per second, time, hashfull and the pv as text
+typedef void (*js_info_callback)(int, int, int, int, double, double, int, int, const char*);
+
 extern "C" {
     EMSCRIPTEN_KEEPALIVE
     void init_engine()
     {
         init_all();
+        if (!wrapper_state::context) wrapper_state::context = std::make_unique<EngineContext>();
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    void set_info_callback(js_info_callback callback) {
+        // a function pointer from addFunction(callback, 'viiiiddiii'), or 0 to stop reporting.
+        // only the calling thread reports, so this also works with the helper threads of the threaded module
+        if (callback == nullptr)
+        {
+            wrapper_state::context->engine().set_info_callback(nullptr);
+            return;
+        }
+        wrapper_state::context->engine().set_info_callback([callback](const search_info &info) {
+            string principal_variation;
+            for (unsigned int move : info.principal_variation) principal_variation += uci::move_to_uci(move) + " ";
+            if (!principal_variation.empty()) principal_variation.pop_back();
+            callback(info.depth, info.selective_depth, info.multi_pv, info.evaluation, (double)info.nodes, (double)info.nodes_per_second,
+                     info.time, info.hashfull, principal_variation.c_str());
+        });
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    void set_threads(int threads)
+    {
+        // the single-threaded module cannot start threads, so it always searches alone
+#ifdef __EMSCRIPTEN_PTHREADS__
+        wrapper_state::context->engine().set_threads(threads);
+#endif
     }
 
     EMSCRIPTEN_KEEPALIVE
     const char* get_best_move(int time_milli_seconds) {
-        int evaluation = wrapper_state::engine.iterative_search(wrapper_state::state, time_milli_seconds);
-        unsigned int best_move = wrapper_state::engine.best_move();
-        string move = move_to_string(best_move);
+        wrapper_state::context->engine().iterative_search(wrapper_state::context->position(), time_milli_seconds);
+        unsigned int best_move = wrapper_state::context->engine().best_move();
+        string move = best_move != 0 ? move_to_string(best_move) : "0000";  // no legal move
 
         static char buffer[6]; 
         strcpy(buffer, move.c_str());
@@ -42,31 +73,96 @@ extern "C" {
     }
 
     EMSCRIPTEN_KEEPALIVE
-    int make_move(const char* move) {
-        string cppmove = move;
-        std::erase(cppmove, ' ');
-        unsigned int encoded_move = encode_move(wrapper_state::state, cppmove);
+    const char* get_best_move_clock(int time_left, int increment, int moves_to_go) {
+        search_limits limits;
+        limits.time_left = time_left;
+        limits.increment = increment;
+        limits.moves_to_go = moves_to_go;
+        wrapper_state::context->engine().iterative_search(wrapper_state::context->position(), limits);
+        unsigned int best_move = wrapper_state::context->engine().best_move();
+        string move = best_move != 0 ? move_to_string(best_move) : "0000";  // no legal move
+
+        static char buffer[6];
+        strcpy(buffer, move.c_str());
+        return buffer;
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    void start_search(int time_left, int increment, int moves_to_go) {
+        // the search runs in slices of search_step, so that the page can keep handling events in between
+        search_limits limits;
+        limits.time_left = time_left;
+        limits.increment = increment;
+        limits.moves_to_go = moves_to_go;
+        wrapper_state::context->engine().start_search(wrapper_state::context->position(), limits);
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    int search_step(int budget_milli_seconds) {
+        return wrapper_state::context->engine().search_step(budget_milli_seconds);
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    const char* get_result() {
+        unsigned int best_move = wrapper_state::context->engine().best_move();
+        string move = best_move != 0 ? move_to_string(best_move) : "0000";  // no legal move
 
-        array<unsigned int, 218> move_list;
-        span<unsigned int> moves = generate_moves(wrapper_state::state, move_list, false);
-        bool legal_move = std::ranges::contains(moves, encoded_move);  // this way is in C++23 I believe but not in C++20
-        // bool legal_move = std::ranges::find(moves, encoded_move) != moves.end();
+        static char buffer[6];
+        strcpy(buffer, move.c_str());
+        return buffer;
+    }
 
-        if (legal_move)
+    EMSCRIPTEN_KEEPALIVE
+    void stop_search() {
+        // the search notices this in its next slice and finishes with the best move so far
+        wrapper_state::context->engine().stop();
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    const char* analyse(int time_milli_seconds, int lines) {
+        // one line per principal variation: "evaluation depth move move ..."
+        wrapper_state::context->engine().set_multi_pv(lines);
+        wrapper_state::context->engine().iterative_search(wrapper_state::context->position(), time_milli_seconds);
+        wrapper_state::context->engine().set_multi_pv(1);
+
+        static string buffer;
+        buffer.clear();
+        for (const principal_variation &line : wrapper_state::context->engine().get_principal_variations())
         {
-            wrapper_state::state = make_move(wrapper_state::state, encoded_move);
-            return 1;
+            buffer += std::to_string(line.evaluation) + " " + std::to_string(line.depth);
+            for (unsigned int move : line.moves) buffer += " " + uci::move_to_uci(move);
+            buffer += "\n";
         }
-        // std::cout << cppmove << std::endl << std::endl;
-        // board_utils::print_move_list(moves);
+        return buffer.c_str();
+    }
 
-        return 0;
+    EMSCRIPTEN_KEEPALIVE
+    int make_move(const char* move) {
+        // accepts the moves from the page and the ones returned above, which may have a trailing space and an uppercase promotion
+        string cppmove = move;
+        std::erase(cppmove, ' ');
+        std::ranges::transform(cppmove, cppmove.begin(), [](unsigned char c) { return std::tolower(c); });
+        return wrapper_state::context->play_move(cppmove);
     }
 
+    // 0 if the fen is valid, otherwise the fen_error and the position is kept
     EMSCRIPTEN_KEEPALIVE
-    void new_state(const char* fen) {
+    int new_state(const char* fen) {
         string cppfen = fen;
-        wrapper_state::state = parse_fen(cppfen);
-        // board_utils::print_board(wrapper_state::state);
+        board_utils::fen_error error;
+        wrapper_state::context->set_position(cppfen, error);
+        return (int)error;
+    }
+
+    // the page mounts IndexedDB at /experience and syncs it before loading and after saving,
+    // so that the engine keeps its deepest results between page loads
+    EMSCRIPTEN_KEEPALIVE
+    int load_experience() {
+        return wrapper_state::context->engine().get_transposition_table()->load_experience(wrapper_state::experience_path);
+    }
+
+    EMSCRIPTEN_KEEPALIVE
+    int save_experience() {
+        return wrapper_state::context->engine().get_transposition_table()->save_experience(wrapper_state::experience_path);
     }
 }
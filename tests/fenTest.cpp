@@ -0,0 +1,81 @@
+#include "testing.h"
+#include "Board/board.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <string>
+#include <string_view>
+#include <array>
+
+using std::string;
+using std::string_view;
+using std::array;
+using board::board_state;
+using board_utils::fen_error;
+
+
+// fens are written back as they were read, and every kind of invalid fen is rejected with its own error
+int main()
+{
+    piece_attacks::init_all();
+
+    const string valid[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+        "rnbqkbnr/pppp1ppp/8/8/3Pp3/8/PPP1PPPP/RNBQKBNR b Kq d3 0 2",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 37 112",
+        "7k/6Q1/6K1/8/8/8/8/8 b - - 0 1",
+    };
+    for (const string &fen : valid)
+    {
+        board_state board;
+        fen_error error = board_utils::parse_fen(fen, board);
+        test_utils::check(error == fen_error::none, fen + ": " + board_utils::fen_error_text(error));
+        test_utils::check(board_utils::to_fen(board) == fen, fen + " is written as " + board_utils::to_fen(board));
+        test_utils::check(board.zobrist_hash == board_utils::get_zobrist_hash(board), fen + " has its zobrist hash");
+    }
+
+    // the clocks are optional and default to 0 and 1
+    board_state board;
+    test_utils::check(board_utils::parse_fen("8/8/4k3/8/8/4K3/8/8 w - -", board) == fen_error::none, "a fen without clocks is valid");
+    test_utils::check(board_utils::to_fen(board) == "8/8/4k3/8/8/4K3/8/8 w - - 0 1", "the clocks default to 0 and 1");
+
+    struct invalid_case {
+        string fen;
+        fen_error error;
+    };
+    const invalid_case invalid[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1", fen_error::placement},
+        {"rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", fen_error::placement},
+        {"rnbqkbnr/ppppxppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", fen_error::placement},
+        {"rnbq1bnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1", fen_error::kings},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBKKBNR w kq - 0 1", fen_error::kings},
+        {"P3k3/8/8/8/8/8/8/4K3 w - - 0 1", fen_error::pawns},
+        {"4k3/8/8/8/8/8/8/3pK3 w - - 0 1", fen_error::pawns},
+        {"rnbqkbnr/pppppppp/8/8/8/7P/PPPPPPPP/RNBQKBNR w KQkq - 0 1", fen_error::piece_count},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1", fen_error::side},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkx - 0 1", fen_error::castling},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KKkq - 0 1", fen_error::castling},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e3 0 1", fen_error::enpassant},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - -1 1", fen_error::clocks},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 x", fen_error::clocks},
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 e4", fen_error::trailing_text},
+        {"7k/6Q1/6K1/8/8/8/8/8 w - - 0 1", fen_error::king_capturable},
+    };
+    for (const invalid_case &test : invalid)
+    {
+        fen_error error = board_utils::parse_fen(test.fen, board);
+        test_utils::check(error == test.error, test.fen + ": " + board_utils::fen_error_text(error) + " instead of " + board_utils::fen_error_text(test.error));
+    }
+
+    // the batch parser skips empty lines and reports the error of every other line
+    string_view text = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1\n\n8/8/8 w - - 0 1\n7k/6Q1/6K1/8/8/8/8/8 b - - 0 1";
+    array<board_state, 4> boards;
+    array<fen_error, 4> errors;
+    size_t position = 0;
+    size_t filled = board_utils::parse_fen_lines(text, position, boards, errors);
+    test_utils::check(filled == 3 && position == text.size(), "three fens are read from four lines");
+    test_utils::check(errors[0] == fen_error::none && errors[1] == fen_error::placement && errors[2] == fen_error::none, "the errors of the lines");
+    test_utils::check(board_utils::to_fen(boards[2]) == valid[5], "the last line is parsed");
+    return test_utils::failures;
+}
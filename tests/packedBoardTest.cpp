@@ -0,0 +1,54 @@
+#include "testing.h"
+#include "Board/board.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <string>
+#include <array>
+#include <span>
+#include <random>
+
+using std::string;
+using std::array;
+using std::span;
+using board::board_state;
+
+
+// every position of random games survives packing and unpacking, including castling rights and en passant squares
+int main()
+{
+    piece_attacks::init_all();
+
+    const string starts[] = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+        "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+        "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    };
+    std::mt19937 random(12345);
+    int positions = 0;
+    for (const string &start : starts)
+    {
+        for (int game = 0; game < 50; game++)
+        {
+            board_state board = board_utils::parse_fen(start);
+            for (int ply = 0; ply < 80; ply++)
+            {
+                board::packed_board packed = board_utils::pack_board(board);
+                board_state unpacked = board_utils::unpack_board(packed, board.halfmove_clock, board.fullmove_number);
+                string fen = board_utils::to_fen(board);
+                test_utils::check(board_utils::to_fen(unpacked) == fen, fen + " unpacks to " + board_utils::to_fen(unpacked));
+                test_utils::check(unpacked.zobrist_hash == board.zobrist_hash, fen + " keeps its zobrist hash");
+                test_utils::check(board_utils::pack_board(unpacked) == packed, fen + " packs the same twice");
+                positions++;
+
+                array<unsigned int, max_moves> move_list;
+                span<unsigned int> moves = move_generator::generate_moves(board, move_list, false);
+                if (moves.empty()) break;
+                board = board::make_move(board, moves[random() % moves.size()]);
+            }
+        }
+    }
+    test_utils::check(positions > 10000, "enough positions were played");
+    return test_utils::failures;
+}
@@ -0,0 +1,36 @@
+#include "testing.h"
+#include "Board/board.h"
+#include "MoveGenerator/MoveGenerator.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <string>
+
+using std::string;
+using std::to_string;
+
+
+// move generation against the known node counts of the usual perft positions, shallow enough for a debug build
+int main()
+{
+    piece_attacks::init_all();
+
+    struct perft_case {
+        string fen;
+        int depth;
+        int nodes;
+    };
+    const perft_case cases[] = {
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4, 197281},
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862},
+        {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+        {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333},
+        {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+        {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 3, 89890},
+    };
+    for (const perft_case &test : cases)
+    {
+        int nodes = move_generator::perft(board_utils::parse_fen(test.fen), test.depth);
+        test_utils::check(nodes == test.nodes, test.fen + " at depth " + to_string(test.depth) + ": " + to_string(nodes) + " nodes instead of " + to_string(test.nodes));
+    }
+    return test_utils::failures;
+}
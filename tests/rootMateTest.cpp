@@ -0,0 +1,51 @@
+#include "testing.h"
+#include "engineContext.h"
+#include "uci.h"
+#include "MoveGenerator/AttackTables.h"
+
+#include <string>
+
+using std::string;
+
+
+// the root of a search without legal moves is reported as mated or drawn, with the null move as best move
+int main()
+{
+    piece_attacks::init_all();
+
+    struct root_case {
+        string fen;
+        int evaluation;
+        string score;  // as printed in uci
+        string best_move;
+    };
+    const root_case cases[] = {
+        {"7k/6Q1/6K1/8/8/8/8/8 b - - 0 1", -constants::check_mate_score, "mate 0", "0000"},  // mated
+        {"7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", 0, "cp 0", "0000"},  // stalemate
+        {"6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1", constants::check_mate_score - 1, "mate 1", "d1d8"},
+    };
+    for (int lines : {1, 3})
+    {
+        for (const root_case &test : cases)
+        {
+            EngineContext context;
+            test_utils::check(context.set_position(test.fen), test.fen + " is valid");
+            Engine &engine = context.engine();
+            engine.set_multi_pv(lines);
+            string reported;  // the best line of the last iteration
+            engine.set_info_callback([&](const search_info &info) {
+                if (info.multi_pv == 1) reported = uci::score_to_uci(info.evaluation);
+            });
+
+            search_limits limits;
+            limits.depth = 4;
+            int evaluation = engine.iterative_search(context.position(), limits);
+            unsigned int best_move = engine.best_move();
+            string description = test.fen + " with " + std::to_string(lines) + " lines";
+            test_utils::check(evaluation == test.evaluation, description + ": evaluation " + std::to_string(evaluation));
+            test_utils::check(reported == test.score, description + ": reported " + reported);
+            test_utils::check((best_move != 0 ? uci::move_to_uci(best_move) : "0000") == test.best_move, description + ": best move");
+        }
+    }
+    return test_utils::failures;
+}
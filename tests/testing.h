@@ -0,0 +1,21 @@
+#ifndef test_helpers
+#define test_helpers
+
+#include <iostream>
+#include <string>
+
+
+// the tests are plain executables run by ctest, a test fails if its main returns anything but 0
+namespace test_utils
+{
+    inline int failures = 0;
+
+    inline void check(bool condition, const std::string &description)
+    {
+        if (condition) return;
+        std::cerr << "failed: " << description << std::endl;
+        failures++;
+    }
+}
+
+#endif  // test_helpers